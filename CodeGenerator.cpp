@@ -0,0 +1,145 @@
+#include "CodeGenerator.h"
+
+#include <stdexcept>
+#include <cctype>
+#include <vector>
+
+/* A byte as a case label: a character literal if it is printable. */
+static std::string label(const unsigned char& c) {
+
+  if (std::isalnum(c) || (std::ispunct(c) && c != '\'' && c != '\\'))
+
+    return std::string("'") + static_cast<char>(c) + "'";
+
+  return std::to_string(static_cast<unsigned>(c));
+}
+
+/**
+ * Writes a matcher for a DFA.
+ *
+ * The code needs <cstddef>, <cstdint> and <string> to be included first.
+ *
+ * @param fa    The DFA, as returned by FA::normalize.
+ * @param name  The name of the struct to write, which must be an identifier.
+ * @param style Whether to use a table or a switch.
+ * @param out   Where to write it.
+ * @throws      std::invalid_argument if fa is not a DFA.
+ */
+void CodeGenerator::generate( const FA& fa, const std::string& name,
+                              const CodeStyle& style, std::ostream& out) {
+
+  const DFA* dfa = dynamic_cast<const DFA*>(&fa);
+
+  if (!dfa)
+
+    throw std::invalid_argument("CodeGenerator needs a DFA; see FA::normalize.");
+
+  out << "struct " << name << " {\n\n"
+      << "  static bool match(const char* arr, std::size_t n) {\n\n";
+
+  if (style == CodeStyle::TABLE)
+
+    generateTable(*dfa, out);
+
+  else
+
+    generateSwitch(*dfa, out);
+
+  out << "  }\n\n"
+      << "  static bool match(const std::string& str) {\n\n"
+      << "    return match(str.data(), str.size());\n"
+      << "  }\n"
+      << "};\n";
+}
+
+/* The table has a row for the dead state, like DFA's own, and uses the
+ * smallest type which can hold every state.
+ */
+void CodeGenerator::generateTable(const DFA& dfa, std::ostream& out) {
+
+  const size_t rows  = dfa.state_count + 1;
+  const size_t count = dfa.byte_classes.count;
+
+  const std::string type = rows <= 0x100   ? "std::uint8_t"  :
+                           rows <= 0x10000 ? "std::uint16_t" : "std::uint32_t";
+
+  out << "    static constexpr unsigned char classes[256] = {";
+
+  for (size_t c = 0; c < 256; ++c)
+
+    out << (c % 16 ? " " : "\n      ")
+        << static_cast<unsigned>(dfa.byte_classes.classOf[c]) << ",";
+
+  out << "\n    };\n\n"
+      << "    static constexpr " << type << " table[" << rows << "][" << count
+      << "] = {\n";
+
+  for (size_t q = 0; q < rows; ++q) {
+
+    out << "      {";
+
+    for (size_t c = 0; c < count; ++c)
+
+      out << (c ? ", " : "") << dfa.table[q * count + c];
+
+    out << "},\n";
+  }
+
+  out << "    };\n\n"
+      << "    static constexpr bool accepting[" << rows << "] = {";
+
+  for (size_t q = 0; q < rows; ++q)
+
+    out << (q % 16 ? " " : "\n      ") << (dfa.accepting[q] ? "1," : "0,");
+
+  out << "\n    };\n\n"
+      << "    " << type << " q = " << dfa.initial_state << ";\n\n"
+      << "    for (std::size_t i = 0; i < n && q != " << dfa.dead_state
+      << "; ++i)\n\n"
+      << "      q = table[q][classes[static_cast<unsigned char>(arr[i])]];\n\n"
+      << "    return accepting[q];\n";
+}
+
+/* Each state is a label. Bytes which lead to the same state share a case,
+ * and missing transitions fall through to the default, which rejects.
+ */
+void CodeGenerator::generateSwitch(const DFA& dfa, std::ostream& out) {
+
+  const size_t count = dfa.byte_classes.count;
+
+  /* The bytes of each class, in order of their first byte. */
+  std::vector<std::vector<unsigned char>> bytes(count);
+
+  for (size_t c = 0; c < 256; ++c)
+
+    bytes[dfa.byte_classes.classOf[c]].push_back(c);
+
+  out << "    const char* end = arr + n;\n\n"
+      << "    goto s" << dfa.initial_state << ";\n";
+
+  for (size_t q = 0; q < dfa.state_count; ++q) {
+
+    out << "\n  s" << q << ":\n\n"
+        << "    if (arr == end) return " << (dfa.accepting[q] ? "true" : "false")
+        << ";\n\n"
+        << "    switch (static_cast<unsigned char>(*arr++)) {\n";
+
+    for (size_t c = 1; c < count; ++c) {
+
+      const FA::state_type next = dfa.table[q * count + c];
+
+      if (next == dfa.dead_state) continue;
+
+      out << "     ";
+
+      for (const unsigned char& b : bytes[c])
+
+        out << " case " << label(b) << ":";
+
+      out << " goto s" << next << ";\n";
+    }
+
+    out << "      default: return false;\n"
+        << "    }\n";
+  }
+}
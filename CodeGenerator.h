@@ -0,0 +1,36 @@
+#pragma once
+
+#include "FA.h"
+#include "DFA.h"
+
+#include <string>
+#include <ostream>
+
+/* How CodeGenerator writes a matcher. */
+enum class CodeStyle {
+
+  TABLE,  // A constexpr transition table, run by a loop.
+  SWITCH  // One label per state, with a switch on the next byte and a goto.
+};
+
+/**
+ * Writes C++ source for a matcher which accepts what a DFA accepts.
+ *
+ * The matcher is a struct with static match() functions for a pointer and a
+ * length or a std::string, and needs nothing but the standard library, so a
+ * fixed set of regexes can be compiled ahead of time into a program with no
+ * FA::fromRegex, no heap and no virtual calls at run time. The fa-gen tool
+ * does this for a file of named regexes.
+ */
+class CodeGenerator {
+
+public:
+
+  static void generate( const FA&, const std::string& name, const CodeStyle&,
+                        std::ostream&);
+
+private:
+
+  static void generateTable (const DFA&, std::ostream&);
+  static void generateSwitch(const DFA&, std::ostream&);
+};
@@ -2,104 +2,651 @@
 
 #include "NFA.h"
 #include "FABuilder.h"
-#include "FAExcept.h"
+#include "SparseSet.h"
+#include "Scratch.h"
+#include "ThreadPool.h"
 
 #include <set>
 #include <map>
 #include <vector>
+#include <numeric>
 #include <algorithm>
 #include <functional>
+#include <unordered_map>
+#include <mutex>
+
+/**
+ * A DFA which finds where the leftmost match of another DFA ends.
+ *
+ * Its states are those of DFA::searchThreads between two symbols: a list of
+ * the DFA's states (at most one thread each, in order of their starts) and
+ * whether a match has been found yet. A transition does what one iteration
+ * of that loop does, so matches end in the same place, but the states do not
+ * record where their threads started, so each symbol takes one lookup.
+ */
+struct DFA::SearchAutomaton {
+
+  /* No threads, and no match found yet. */
+  static const state_type START = 0;
+
+  /* Indexed by state * byte_classes.count + byte class. */
+  std::vector<state_type> table;
+
+  /* Whether a match ends at a position in this state, if that position is not
+   * the end of the input.
+   */
+  std::vector<char> match;
+
+  /* Whether a match ends at the end of the input in this state. */
+  std::vector<char> matchAtEnd;
+
+  /* Whether the search is over once any match here is recorded. */
+  std::vector<char> stop;
+};
+
+const FA::state_type DFA::SearchAutomaton::START;
+
+const size_t DFA::MIN_CHUNK;
+const size_t DFA::MAX_ENUMERATED;
+const size_t DFA::LOOKBACK;
+
+struct DFA::TwoPhase {
+
+  /* One for each MatchSemantics. Null if the automaton would be too big. */
+  std::once_flag                         forwardBuilt[2];
+  std::unique_ptr<const SearchAutomaton> forward[2];
+
+  /* The reverse of the DFA, which finds where a match starts from its end. */
+  std::once_flag             backwardBuilt;
+  std::unique_ptr<const DFA> backward;
+};
+
+/* Beyond this, DFA::search keeps track of its threads itself. */
+static const size_t MAX_SEARCH_STATES = 10000;
+
+DFA::DFA(const state_type& initial_state,
+         const std::vector<state_type>& final_states,
+         const std::vector<symbol_type>& symbols,
+         const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions,
+         const ByteClasses& byte_classes) :
+  FA(initial_state, final_states, symbols, transitions, byte_classes),
+  dead_state(state_count),
+  table((state_count + 1) * byte_classes.count, dead_state),
+  accepting(state_count + 1, false),
+  two_phase(std::make_shared<TwoPhase>()) {
 
-bool DFA::match(const char* arr, const size_t& n) const {
-
-  try {
+  for (size_t i = 0; i < symbols.size(); ++i) {
 
-    state_type final_state = delta(initial_state, arr, arr + n);
+    const unsigned char c =
+      byte_classes.classOf[static_cast<unsigned char>(symbols[i])];
 
-    return std::binary_search(std::begin(final_states), std::end(final_states),
-                              final_state);
-  } catch (const NoTransitionException& e) {
+    for (const std::pair<state_type, state_type>& pair : transitions[i])
 
-    return false;
+      table[pair.first * byte_classes.count + c] = pair.second;
   }
+
+  for (const state_type& f : final_states)
+
+    accepting[f] = true;
+}
+
+bool DFA::match(const char* arr, const size_t& n) const {
+
+  return matchStatus(arr, n) == MatchStatus::MATCH;
 }
 
 bool DFA::match(std::string::const_iterator first,
                 std::string::const_iterator last) const {
 
-  try {
+  return status(delta(initial_state, first, last)) == MatchStatus::MATCH;
+}
+
+MatchStatus DFA::matchStatus(const char* arr, const size_t& n) const {
+
+  return status(delta(initial_state, arr, arr + n));
+}
+
+/**
+ * Matches one long input by running a chunk of it on each of a pool's
+ * threads at once.
+ *
+ * No chunk but the first knows which state it starts in, so each one is run
+ * from every state (or, for a big DFA, from a guess), giving a map from start
+ * states to end states. Following the maps from the initial state, chunk by
+ * chunk, gives exactly the state matchStatus would reach. If a guess was
+ * wrong, that chunk is run again from the right state on the calling thread.
+ *
+ * @param  arr  The input.
+ * @param  n    Its length.
+ * @param  pool The threads to use.
+ * @return      The same as matchStatus(arr, n).
+ */
+MatchStatus DFA::matchStatusParallel(const char* arr, const size_t& n,
+                                     ThreadPool& pool) const {
+
+  const size_t chunks = std::min(pool.size(), n / MIN_CHUNK);
+
+  if (chunks <= 1)
+
+    return matchStatus(arr, n);
+
+  std::vector<std::vector<state_type>> starts(chunks), ends(chunks);
 
-    state_type final_state = delta(initial_state, first, last);
+  pool.parallelFor(chunks, 1, [&] (const size_t& firstChunk,
+                                   const size_t& lastChunk) {
 
-    return std::binary_search(std::begin(final_states), std::end(final_states),
-                              final_state);
-  } catch (const NoTransitionException& e) {
+    for (size_t i = firstChunk; i < lastChunk; ++i) {
 
-    return false;
+      const char* first = arr + i * n / chunks;
+      const char* last  = arr + (i + 1) * n / chunks;
+
+      if (i == 0)
+
+        starts[i].assign(1, initial_state);
+
+      else if (state_count <= MAX_ENUMERATED) {
+
+        starts[i].resize(state_count);
+
+        std::iota(std::begin(starts[i]), std::end(starts[i]), 0);
+      }
+      else
+
+        starts[i].assign(1, delta(initial_state,
+                                  first - std::min<size_t>(LOOKBACK, first - arr),
+                                  first));
+
+      runAll(starts[i], first, last, ends[i]);
+    }
+  });
+
+  state_type q = initial_state;
+
+  for (size_t i = 0; i < chunks && q != dead_state; ++i) {
+
+    auto it = std::find(std::begin(starts[i]), std::end(starts[i]), q);
+
+    q = it != std::end(starts[i]) ?
+      ends[i][it - std::begin(starts[i])] :
+      delta(q, arr + i * n / chunks, arr + (i + 1) * n / chunks);
   }
+
+  return status(q);
 }
 
-std::pair<const char*, const size_t> DFA::findNext( const char* arr,
-                                                    const size_t& n) const {
+/**
+ * Runs the DFA over [first, last) from several states at once.
+ *
+ * Runs which reach the same state go the same way from then on, so they are
+ * merged, at intervals which double, and on most DFAs only one is left after
+ * a few dozen bytes. From then on this is as fast as delta.
+ *
+ * @param starts The states to start from.
+ * @param first  The beginning of the input.
+ * @param last   The end of the input.
+ * @param ends   Receives the state each run ends in, in the order of starts.
+ */
+void DFA::runAll(const std::vector<state_type>& starts,
+                 const char* first, const char* last,
+                 std::vector<state_type>& ends) const {
+
+  const size_t NO_RUN = static_cast<size_t>(-1);
+  const size_t MAX_INTERVAL = 1 << 16;
+
+  /* The distinct states the runs are in, and which of them each run is. */
+  std::vector<state_type> runs(starts);
+  std::vector<size_t> runOf(starts.size());
+
+  std::iota(std::begin(runOf), std::end(runOf), 0);
+
+  std::vector<size_t> slot(state_count + 1, NO_RUN);
+  std::vector<size_t> merged(runs.size());
+
+  for (size_t interval = 16; first != last;
+       interval = std::min(2 * interval, MAX_INTERVAL)) {
+
+    if (runs.size() == 1) {
+
+      runs.front() = delta(runs.front(), first, last);
+      break;
+    }
+
+    const char* stop = first + std::min<size_t>(interval, last - first);
+
+    for (; first != stop; ++first) {
+
+      const size_t c = byte_classes.classOf[static_cast<unsigned char>(*first)];
 
-  if (n == 0) return {arr + n, n};
+      for (state_type& q : runs)
 
-  state_type currState = initial_state;
-  size_t endPos = 0;
+        q = table[q * byte_classes.count + c];
+    }
+
+    size_t live = 0;
+
+    for (size_t i = 0; i < runs.size(); ++i) {
+
+      const state_type q = runs[i];
+
+      if (slot[q] == NO_RUN) {
 
-  try {
+        slot[q] = live;
+        runs[live++] = q;
+      }
 
-    while (!std::binary_search( std::begin(final_states), std::end(final_states),
-                                currState))
+      merged[i] = slot[q];
+    }
+
+    for (size_t i = 0; i < live; ++i)
+
+      slot[runs[i]] = NO_RUN;
 
-      currState = delta(currState, arr[endPos++]);
+    if (live == runs.size()) continue;
 
-    return {arr, endPos};
-  } catch (const NoTransitionException& e) {
+    for (size_t& r : runOf)
 
-    return findNext(arr + 1, n - 1);
+      r = merged[r];
+
+    runs.resize(live);
   }
+
+  ends.resize(starts.size());
+
+  for (size_t i = 0; i < starts.size(); ++i)
+
+    ends[i] = runs[runOf[i]];
+}
+
+std::pair<const char*, const size_t> DFA::findNext( const char* arr,
+                                                    const size_t& n) const {
+
+  const std::pair<const char*, const char*> found =
+    search(arr, arr + n, MatchSemantics::LEFTMOST_LONGEST);
+
+  return {found.first, found.second - found.first};
 }
 
 std::pair<std::string::const_iterator, std::string::const_iterator>
   DFA::findNext(std::string::const_iterator first,
                 std::string::const_iterator last) const {
 
-  if (first == last) return {last, last};
+  return search(first, last, MatchSemantics::LEFTMOST_LONGEST);
+}
+
+std::pair<const char*, const char*> DFA::find(
+  const char* first, const char* last,
+  const MatchSemantics& semantics) const {
+
+  return search(first, last, semantics);
+}
+
+std::pair<std::string::const_iterator, std::string::const_iterator>
+  DFA::find(std::string::const_iterator first,
+            std::string::const_iterator last,
+            const MatchSemantics& semantics) const {
+
+  return search(first, last, semantics);
+}
+
+/**
+ * Finds the leftmost substring of [first, last) which the DFA accepts, in two
+ * passes.
+ *
+ * The first pass runs a SearchAutomaton forwards until it knows where the
+ * match ends, skipping ahead when it has no threads as searchThreads does.
+ * The leftmost match is then the one which starts earliest among those which
+ * end there, so the second pass runs the reversed DFA backwards from its end,
+ * and the match starts at the last final state reached. If the
+ * SearchAutomaton would be too big, searchThreads is used instead.
+ *
+ * @param  first     The beginning of the input.
+ * @param  last      The end of the input.
+ * @param  semantics Whether to stop at the first final state or the last.
+ * @return           The bounds of the match, or {last, last} if there is none.
+ */
+template <typename InputIterator>
+std::pair<InputIterator, InputIterator> DFA::search(
+  InputIterator first, InputIterator last,
+  const MatchSemantics& semantics) const {
+
+  TwoPhase& automata = *two_phase;
+
+  const size_t i = static_cast<size_t>(semantics);
+
+  std::call_once(automata.forwardBuilt[i], [&]() {
+
+    automata.forward[i] = searchAutomaton(semantics);
+  });
+
+  if (!automata.forward[i])
+
+    return searchThreads(first, last, semantics);
+
+  std::call_once(automata.backwardBuilt, [&]() {
+
+    automata.backward.reset(
+      static_cast<DFA*>(FA::normalize(reverse()).release()));
+  });
+
+  const SearchAutomaton& forward  = *automata.forward[i];
+  const DFA&             backward = *automata.backward;
+
+  bool found = false;
+  InputIterator end = last;
+
+  const Prefilter& filter = searchPrefilter();
+
+  InputIterator candidate = nextLiteral(first, last);
+
+  state_type q = SearchAutomaton::START;
+
+  for (InputIterator currIt = first; ; ++currIt) {
+
+    if (q == SearchAutomaton::START) {
+
+      if (candidate < currIt)
+
+        candidate = nextLiteral(currIt, last);
+
+      if (candidate == last)
+
+        return {last, last};
+
+      if (filter.literal.prefix)
+
+        currIt = candidate;
+
+      else if (!filter.prefixes.empty())
+
+        currIt = nextPrefix(currIt, last);
+    }
+
+    if (currIt == last) {
+
+      if (forward.matchAtEnd[q]) {
+
+        found = true;
+        end = currIt;
+      }
+
+      break;
+    }
+
+    if (forward.match[q]) {
+
+      found = true;
+      end = currIt;
+    }
+
+    if (forward.stop[q]) break;
+
+    q = forward.table[q * byte_classes.count +
+                      byte_classes.classOf[static_cast<unsigned char>(*currIt)]];
+  }
+
+  if (!found)
+
+    return {last, last};
+
+  InputIterator start = end;
+
+  q = backward.initial_state;
+
+  for (InputIterator currIt = end; currIt != first; ) {
+
+    q = backward.delta(q, *--currIt);
+
+    if (q == backward.dead_state) break;
+
+    if (backward.accepting[q])
+
+      start = currIt;
+  }
+
+  return {start, end};
+}
+
+/**
+ * Finds the leftmost substring of [first, last) which the DFA accepts.
+ *
+ * Rather than trying each starting position in turn, this runs the DFA as if
+ * it were prefixed by .*, like NFA::search: a thread is started in the
+ * initial state at every position and tagged with it, threads are kept in
+ * order of their starts, and only the earliest thread in each state
+ * survives. So there are never more threads than states, and the input is
+ * read once. Empty matches are only reported before the end of the input.
+ *
+ * @param  first     The beginning of the input.
+ * @param  last      The end of the input.
+ * @param  semantics Whether to stop at the first final state or the last.
+ * @return           The bounds of the match, or {last, last} if there is none.
+ */
+template <typename InputIterator>
+std::pair<InputIterator, InputIterator> DFA::searchThreads(
+  InputIterator first, InputIterator last,
+  const MatchSemantics& semantics) const {
+
+  const bool longest = semantics == MatchSemantics::LEFTMOST_LONGEST;
+
+  SparseSet& currStates = Scratch::set(Scratch::DFA_CURRENT, state_count);
+  SparseSet& nextStates = Scratch::set(Scratch::DFA_NEXT, state_count);
+  std::vector<InputIterator>& currStarts =
+    Scratch::vector<InputIterator>(Scratch::DFA_CURRENT, state_count);
+  std::vector<InputIterator>& nextStarts =
+    Scratch::vector<InputIterator>(Scratch::DFA_NEXT, state_count);
+
+  bool found = false;
+  std::pair<InputIterator, InputIterator> match {last, last};
+
+  const Prefilter& filter = searchPrefilter();
+
+  InputIterator candidate = nextLiteral(first, last);
+
+  for (InputIterator currIt = first; ; ++currIt) {
+
+    /* Skip ahead to the required literal, as in NFA::search. */
+    if (!found && currStates.empty()) {
+
+      if (candidate < currIt)
+
+        candidate = nextLiteral(currIt, last);
+
+      if (candidate == last)
+
+        return match;
+
+      if (filter.literal.prefix)
+
+        currIt = candidate;
+
+      else if (!filter.prefixes.empty())
+
+        currIt = nextPrefix(currIt, last);
+
+      if (currIt == last)
+
+        return match;
+    }
+
+    if (!found && currIt != last && currStates.insert(initial_state))
+
+      currStarts[initial_state] = currIt;
+
+    /* As in NFA::search, the first final thread has the leftmost start. */
+    for (size_t i = 0; i < currStates.size(); ++i) {
+
+      if (!accepting[currStates[i]]) continue;
+
+      const InputIterator start = currStarts[currStates[i]];
+
+      found = true;
+      match = {start, currIt};
+
+      nextStates.clear();
+
+      for (size_t j = 0; j < currStates.size(); ++j) {
+
+        const state_type& q = currStates[j];
+
+        if (currStarts[q] == start ? !longest : j > i) break;
+
+        nextStates.insert(q);
+      }
+
+      std::swap(currStates, nextStates);
+
+      break;
+    }
+
+    if ((found && currStates.empty()) || currIt == last)
+
+      return match;
+
+    const size_t c = byte_classes.classOf[static_cast<unsigned char>(*currIt)];
+
+    nextStates.clear();
 
-  state_type currState = initial_state;
-  std::string::const_iterator currIt = first;
+    for (const state_type& q : currStates) {
 
-  try {
+      const state_type next = table[q * byte_classes.count + c];
 
-    while (!std::binary_search( std::begin(final_states), std::end(final_states),
-                                currState))
+      if (next != dead_state && nextStates.insert(next))
 
-      currState = delta(currState, *currIt++);
+        nextStarts[next] = currStarts[q];
+    }
+
+    std::swap(currStates, nextStates);
+    std::swap(currStarts, nextStarts);
+  }
+}
+
+/**
+ * Builds the SearchAutomaton for this DFA.
+ *
+ * A state is keyed by its list of threads, followed by 1 if a match has been
+ * found and 0 otherwise. Each of its transitions starts a thread in the
+ * initial state unless a match has been found, prunes the threads as
+ * searchThreads does if one of them is final, and then moves every thread
+ * on by the byte class.
+ *
+ * @param  semantics Whether matches end at the first final state or the last.
+ * @return           The automaton, or null if it has too many states.
+ */
+std::unique_ptr<DFA::SearchAutomaton> DFA::searchAutomaton(
+  const MatchSemantics& semantics) const {
+
+  const bool longest = semantics == MatchSemantics::LEFTMOST_LONGEST;
+
+  std::unique_ptr<SearchAutomaton> search(new SearchAutomaton);
+
+  std::vector<std::vector<state_type>> keys {{0}};
+  std::unordered_map<std::vector<state_type>, state_type, StateSetHash> ids {
+    {keys.front(), SearchAutomaton::START}
+  };
+
+  SparseSet next(state_count);
+
+  for (size_t q = 0; q < keys.size(); ++q) {
+
+    if (keys.size() > MAX_SEARCH_STATES)
+
+      return nullptr;
+
+    std::vector<state_type> threads(std::begin(keys[q]), std::end(keys[q]) - 1);
+    bool found = keys[q].back();
+
+    search->matchAtEnd.push_back(std::any_of(std::begin(threads),
+                                             std::end(threads),
+      [this](const state_type& p) { return accepting[p]; }));
+
+    if (!found && std::find(std::begin(threads), std::end(threads),
+                            initial_state) == std::end(threads))
+
+      threads.push_back(initial_state);
+
+    const auto firstFinal = std::find_if(std::begin(threads), std::end(threads),
+      [this](const state_type& p) { return accepting[p]; });
+
+    search->match.push_back(firstFinal != std::end(threads));
+
+    if (firstFinal != std::end(threads)) {
 
-    return {first, currIt};
-  } catch (const NoTransitionException& e) {
+      found = true;
+      threads.erase(longest ? firstFinal + 1 : firstFinal, std::end(threads));
+    }
+
+    search->stop.push_back(found && threads.empty());
+
+    for (size_t c = 0; c < byte_classes.count; ++c) {
+
+      next.clear();
+
+      for (const state_type& p : threads) {
+
+        const state_type r = table[p * byte_classes.count + c];
+
+        if (r != dead_state)
+
+          next.insert(r);
+      }
+
+      std::vector<state_type> key(std::begin(next), std::end(next));
+
+      key.push_back(found);
 
-    return findNext(++first, last);
+      const auto inserted = ids.emplace(key, keys.size());
+
+      if (inserted.second)
+
+        keys.push_back(std::move(key));
+
+      search->table.push_back(inserted.first->second);
+    }
   }
+
+  return search;
+}
+
+void DFA::startStates(std::vector<state_type>& out) const {
+
+  out.push_back(initial_state);
+}
+
+void DFA::step( const state_type& q, const symbol_type& a,
+                std::vector<state_type>& out) const {
+
+  const state_type next = delta(q, a);
+
+  if (next != dead_state)
+
+    out.push_back(next);
+}
+
+MatchStatus DFA::status(const state_type& q) const {
+
+  if (q == dead_state)
+
+    return MatchStatus::DEAD_STATE;
+
+  return accepting[q] ? MatchStatus::MATCH : MatchStatus::NO_MATCH;
 }
 
-std::unique_ptr<FA> DFA::normalize()      const {
+std::unique_ptr<FA> DFA::normalize(ThreadPool&) const {
 
-  return dynamic_cast<DFA*>(removeDeadStates().get())->minimizeStates();
+  return minimizeStates();
 }
 
-std::unique_ptr<FA> DFA::reverse()        const {
+std::unique_ptr<FA> DFA::reverse()              const {
 
   FABuilder faBuilder;
 
-  std::string q_0 = "q_0";
+  const state_type q_0 = state_count;
 
   faBuilder.initial_state(q_0);
 
   for (const state_type& f : final_states)
 
-    faBuilder.transition(q_0, EPSILON, std::to_string(f));
+    faBuilder.transition(q_0, EPSILON, f);
 
   for (size_t i = 0; i < symbols.size(); ++i) {
 
@@ -107,64 +654,296 @@ std::unique_ptr<FA> DFA::reverse()        const {
 
     for (const std::pair<state_type, state_type>& pair : transitions[i]) {
 
-      faBuilder.transition( std::to_string(pair.second), symbol,
-                            std::to_string(pair.first));
+      faBuilder.transition(pair.second, symbol, pair.first);
     }
   }
 
-  faBuilder.final_state(std::to_string(initial_state));
+  faBuilder.final_state(initial_state);
 
   return faBuilder.build();
 }
 
-/* Uses Brzozowsiki's Algorithm for DFA minimization. */
+/**
+ * Uses Hopcroft's Algorithm for DFA minimization.
+ *
+ * Works on the dense table, with dead_state as an ordinary (non-final) state,
+ * so every state has a transition on every byte class. Only states reachable
+ * from the initial state take part. Blocks are split by the predecessors of
+ * a splitter block on one byte class, and only the smaller half of each split
+ * is queued as a new splitter, which gives O(n k log n) time for n states and
+ * k byte classes.
+ *
+ * States equivalent to dead_state are dropped from the result, and states are
+ * numbered in breadth-first order from the initial state, so equal languages
+ * give identical DFAs.
+ *
+ * @return The minimal DFA.
+ */
 std::unique_ptr<FA> DFA::minimizeStates() const {
 
-  if (final_states.size() == 0)
+  const size_t k = byte_classes.count;
+  const size_t n = state_count + 1;
 
-    return std::unique_ptr<FA>(new DFA(*this));
+  /* Reachable states, dead_state included. */
+  std::vector<state_type> states;
+  std::vector<char> reached(n, false);
 
-  return dynamic_cast<const NFA*>(
-    dynamic_cast<const DFA*>(
-      dynamic_cast<const NFA*>(
-        reverse().get()
-      )->makeDeterministic().get()
-    )->reverse().get()
-  )->makeDeterministic();
-}
+  reached[dead_state] = reached[initial_state] = true;
+  states.push_back(initial_state);
+  states.push_back(dead_state);
 
-template <typename InputIterator>
-FA::state_type DFA::delta(const state_type& q,
-                          InputIterator first, InputIterator last) const {
+  for (size_t i = 0; i < states.size(); ++i) {
 
-  if (first == last) return q;
+    for (size_t c = 0; c < k; ++c) {
 
-  return delta(delta(q, *first), first + 1, last);
-}
+      const state_type next = table[states[i] * k + c];
 
-FA::state_type DFA::delta(const state_type& q, const symbol_type& a) const {
+      if (!reached[next]) {
+
+        reached[next] = true;
+        states.push_back(next);
+      }
+    }
+  }
+
+  /* Predecessors of each reachable state on each byte class, as CSR rows
+   * indexed by q * k + c.
+   */
+  std::vector<size_t> pred_offsets(n * k + 1, 0);
+  std::vector<state_type> pred_sources(states.size() * k);
 
-  size_t i = std::distance( std::begin(symbols),
-                            std::lower_bound( std::begin(symbols),
-                                              std::end(symbols),
-                                              a));
+  for (const state_type& q : states)
+
+    for (size_t c = 0; c < k; ++c)
+
+      ++pred_offsets[table[q * k + c] * k + c + 1];
+
+  std::partial_sum(std::begin(pred_offsets), std::end(pred_offsets),
+                   std::begin(pred_offsets));
+
+  std::vector<size_t> fill(std::begin(pred_offsets), std::end(pred_offsets));
+
+  for (const state_type& q : states)
+
+    for (size_t c = 0; c < k; ++c)
+
+      pred_sources[fill[table[q * k + c] * k + c]++] = q;
+
+  /* The partition. Each block is a contiguous range of elems, and the states
+   * of a block which have been marked are moved to the front of its range.
+   */
+  std::vector<state_type> elems;
+  std::vector<size_t> pos(n), block(n);
+  std::vector<size_t> first, last, marked;
+
+  for (const bool accept : {true, false}) {
+
+    const size_t begin = elems.size();
+
+    for (const state_type& q : states)
+
+      if (static_cast<bool>(accepting[q]) == accept)
+
+        elems.push_back(q);
+
+    if (elems.size() == begin) continue;
+
+    for (size_t i = begin; i < elems.size(); ++i) {
+
+      pos[elems[i]] = i;
+      block[elems[i]] = first.size();
+    }
+
+    first.push_back(begin);
+    last.push_back(elems.size());
+    marked.push_back(0);
+  }
 
-  if (i == transitions.size() || symbols[i] != a)
+  /* Splitters still to be processed, as (block, byte class) pairs. */
+  std::vector<std::pair<size_t, size_t>> pending;
+  std::vector<char> isPending(first.size() * k, false);
 
-    throw NoTransitionException(q, a);
+  auto addSplitter = [&] (const size_t& b, const size_t& c) {
 
-  const std::vector<std::pair<state_type, state_type>> ts = transitions[i];
+    isPending[b * k + c] = true;
+    pending.push_back({b, c});
+  };
 
-  auto it = std::lower_bound( std::begin(ts), std::end(ts), q,
-                              [] (const std::pair<state_type, state_type>& pair,
-                                  const state_type& q) -> bool {
+  /* The blocks partition the states, so one of them alone is enough to start. */
+  if (first.size() == 2) {
 
-                                return pair.first < q;
-                              });
+    const size_t b = last[0] - first[0] <= last[1] - first[1] ? 0 : 1;
 
-  if (it == std::end(ts))
+    for (size_t c = 0; c < k; ++c)
 
-    throw NoTransitionException(q, a);
+      addSplitter(b, c);
+  }
+
+  std::vector<state_type> splitter;
+  std::vector<size_t> touched;
+
+  while (!pending.empty()) {
+
+    const size_t a = pending.back().first;
+    const size_t c = pending.back().second;
+
+    pending.pop_back();
+    isPending[a * k + c] = false;
+
+    /* Copy the splitter, since splitting may reorder it. */
+    splitter.assign(std::begin(elems) + first[a], std::begin(elems) + last[a]);
+
+    for (const state_type& r : splitter) {
+
+      const size_t row = r * k + c;
+
+      for (size_t i = pred_offsets[row]; i < pred_offsets[row + 1]; ++i) {
+
+        const state_type q = pred_sources[i];
+        const size_t b = block[q];
+        const size_t j = first[b] + marked[b];
+
+        if (pos[q] < j) continue;
+
+        std::swap(elems[pos[q]], elems[j]);
+        pos[elems[pos[q]]] = pos[q];
+        pos[q] = j;
+
+        if (marked[b]++ == 0)
+
+          touched.push_back(b);
+      }
+    }
+
+    for (const size_t& b : touched) {
+
+      const size_t split = first[b] + marked[b];
+
+      marked[b] = 0;
+
+      if (split == last[b]) continue;
+
+      /* The marked states become a new block. */
+      const size_t nb = first.size();
+
+      first.push_back(first[b]);
+      last.push_back(split);
+      marked.push_back(0);
+      first[b] = split;
+
+      for (size_t i = first[nb]; i < last[nb]; ++i)
+
+        block[elems[i]] = nb;
+
+      isPending.resize(first.size() * k, false);
+
+      for (size_t d = 0; d < k; ++d) {
+
+        if (isPending[b * k + d])
+
+          addSplitter(nb, d);
+
+        else
+
+          addSplitter(last[nb] - first[nb] <= last[b] - first[b] ? nb : b, d);
+      }
+    }
+
+    touched.clear();
+  }
+
+  /* Number the live blocks in breadth-first order, one representative each. */
+  const size_t deadBlock = block[dead_state];
+
+  std::vector<state_type> number(first.size(), dead_state);
+  std::vector<state_type> representatives;
+
+  if (block[initial_state] != deadBlock) {
+
+    number[block[initial_state]] = 0;
+    representatives.push_back(initial_state);
+  }
+
+  for (size_t i = 0; i < representatives.size(); ++i) {
+
+    for (size_t c = 0; c < k; ++c) {
+
+      const state_type next = table[representatives[i] * k + c];
+      const size_t b = block[next];
+
+      if (b != deadBlock && number[b] == dead_state) {
+
+        number[b] = representatives.size();
+        representatives.push_back(next);
+      }
+    }
+  }
+
+  std::vector<symbol_type> newSymbols;
+  std::vector<std::vector<std::pair<state_type, state_type>>> newTransitions;
+  std::vector<state_type> newFinalStates;
+
+  for (const symbol_type& symbol : symbols) {
+
+    if (symbol == EPSILON) continue;
+
+    const size_t c = byte_classes.classOf[static_cast<unsigned char>(symbol)];
+
+    std::vector<std::pair<state_type, state_type>> pairs;
+
+    for (size_t i = 0; i < representatives.size(); ++i) {
+
+      const size_t b = block[table[representatives[i] * k + c]];
+
+      if (b != deadBlock)
+
+        pairs.push_back({i, number[b]});
+    }
+
+    if (pairs.empty()) continue;
+
+    newSymbols.push_back(symbol);
+    newTransitions.push_back(std::move(pairs));
+  }
+
+  for (size_t i = 0; i < representatives.size(); ++i)
+
+    if (accepting[representatives[i]])
+
+      newFinalStates.push_back(i);
+
+  const ByteClasses newByteClasses =
+    FABuilder::byteClasses(newSymbols, newTransitions);
+
+  return std::unique_ptr<FA>(new DFA( 0, newFinalStates, newSymbols,
+                                      newTransitions, newByteClasses));
+}
+
+template <typename InputIterator>
+FA::state_type DFA::delta(const state_type& q,
+                          InputIterator first, InputIterator last) const {
+
+  state_type currState = q;
+
+  for (; first != last && currState != dead_state; ++first)
+
+    currState = delta(currState, *first);
+
+  return currState;
+}
+
+/* RegexSet runs the table itself. */
+template FA::state_type DFA::delta(const state_type&,
+                                   const char*, const char*) const;
+template FA::state_type DFA::delta(const state_type&,
+                                   std::string::const_iterator,
+                                   std::string::const_iterator) const;
+
+/* Missing transitions lead to dead_state rather than throwing, so rejecting
+ * input never leaves the loop above through an exception.
+ */
+FA::state_type DFA::delta(const state_type& q, const symbol_type& a) const {
 
-  return it->second;
+  return table[q * byte_classes.count +
+               byte_classes.classOf[static_cast<unsigned char>(a)]];
 }
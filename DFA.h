@@ -3,6 +3,8 @@
 #include "FA.h"
 
 #include <set>
+#include <vector>
+#include <memory>
 
 class DFA :
   public FA {
@@ -18,28 +20,89 @@ public:
   virtual bool match( std::string::const_iterator,
                       std::string::const_iterator) const;
 
+  virtual MatchStatus matchStatus(const char*, const size_t&) const;
+
+  virtual MatchStatus matchStatusParallel(const char*, const size_t&,
+                                          ThreadPool&) const;
+
   virtual std::pair<const char*, const size_t> findNext(const char*, 
                                                         const size_t&) const;
 
   virtual std::pair<std::string::const_iterator, std::string::const_iterator>
     findNext(std::string::const_iterator, std::string::const_iterator) const;
 
+  friend class FA;
   friend class FABuilder;
   friend class NFA;
+  friend class RegexSet;
+  friend class CodeGenerator;
+  friend class StreamMatcher;
 
 private:
 
   DFA(const state_type& initial_state,
       const std::vector<state_type>& final_states,
       const std::vector<symbol_type>& symbols,
-      const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions) :
-    FA(initial_state, final_states, symbols, transitions) {}
+      const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions,
+      const ByteClasses& byte_classes);
+
+  virtual void startStates(std::vector<state_type>&) const;
+  virtual void step(const state_type&, const symbol_type&,
+                    std::vector<state_type>&) const;
 
-  virtual std::unique_ptr<FA> normalize()      const;
-          std::unique_ptr<FA> reverse()        const;
-          std::unique_ptr<FA> minimizeStates() const;
+  virtual std::unique_ptr<FA> normalize(ThreadPool&) const;
+          std::unique_ptr<FA> reverse()              const;
+          std::unique_ptr<FA> minimizeStates()       const;
+
+  virtual std::pair<const char*, const char*>
+    find(const char*, const char*, const MatchSemantics&) const;
+  virtual std::pair<std::string::const_iterator, std::string::const_iterator>
+    find( std::string::const_iterator, std::string::const_iterator,
+          const MatchSemantics&) const;
+
+  template <typename InputIterator>
+  std::pair<InputIterator, InputIterator> search(InputIterator, InputIterator,
+                                                 const MatchSemantics&) const;
+  template <typename InputIterator>
+  std::pair<InputIterator, InputIterator> searchThreads(
+    InputIterator, InputIterator, const MatchSemantics&) const;
+
+  struct SearchAutomaton;
+  struct TwoPhase;
+
+  std::unique_ptr<SearchAutomaton> searchAutomaton(const MatchSemantics&) const;
 
   template <typename InputIterator>
   state_type delta(const state_type&, InputIterator, InputIterator) const;
   state_type delta(const state_type&, const symbol_type&) const;
+
+  MatchStatus status(const state_type&) const;
+
+  void runAll(const std::vector<state_type>&, const char*, const char*,
+              std::vector<state_type>&) const;
+
+  /* The least input worth giving a thread of its own. */
+  static const size_t MIN_CHUNK = 1 << 20;
+
+  /* Up to this many states, a chunk is run from every state; past it, from a
+   * guess at its start state, made by running the LOOKBACK bytes before it.
+   */
+  static const size_t MAX_ENUMERATED = 64;
+  static const size_t LOOKBACK       = 1024;
+
+  /* A non-final sink which every missing transition leads to, and which only
+   * leads back to itself. It is numbered one past the last real state.
+   */
+  state_type dead_state;
+
+  /* Dense, row-major transition table with one row per state (including
+   * dead_state) and one column per byte class.
+   */
+  std::vector<state_type> table;
+  std::vector<char>       accepting;
+
+  /* The automata which search() runs, built the first time they are needed
+   * and shared by copies of the DFA.
+   */
+  std::shared_ptr<TwoPhase> two_phase;
 };
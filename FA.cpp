@@ -2,152 +2,642 @@
 
 #include "NFA.h"
 #include "DFA.h"
+#include "LazyDFA.h"
 #include "FABuilder.h"
 #include "FAExcept.h"
+#include "ThreadPool.h"
 
 #include <vector>
 #include <algorithm>
 #include <iterator>
 #include <map>
+#include <cstring>
 
-static std::string prefix(unsigned int faNumber, const FA::state_type& state) {
+std::unique_ptr<FA> FA::concatenate(std::unique_ptr<FA> fa1, 
+                                    std::unique_ptr<FA> fa2) {
 
-  return std::to_string(faNumber) + std::to_string(state);
-}
+  FABuilder faBuilder;
 
-static auto p1 = [&] (const FA::state_type& state) -> std::string {
+  const state_type offset2 = fa1->state_count;
 
-  return prefix(1, state);
-};
+  faBuilder.initial_state(fa1->initial_state);
 
-static auto p2 = [&] (const FA::state_type& state) -> std::string {
+  faBuilder.copy(*fa1, 0);
 
-  return prefix(2, state);
-};
+  for (const state_type& f : fa1->final_states)
 
-std::unique_ptr<FA> FA::concatenate(std::unique_ptr<FA> fa1, 
+    faBuilder.transition(f, EPSILON, offset2 + fa2->initial_state);
+
+  faBuilder.copy(*fa2, offset2);
+
+  for (const state_type& f : fa2->final_states)
+
+    faBuilder.final_state(offset2 + f);
+
+  return faBuilder.build();
+}
+
+std::unique_ptr<FA> FA::alternate  (std::unique_ptr<FA> fa1, 
                                     std::unique_ptr<FA> fa2) {
 
   FABuilder faBuilder;
 
-  faBuilder.initial_state(p1(fa1->initial_state));
+  const state_type offset2 = fa1->state_count;
+  const state_type q_0     = offset2 + fa2->state_count;
+
+  faBuilder.initial_state(q_0);
+  faBuilder.transition(q_0, EPSILON, fa1->initial_state);
+  faBuilder.transition(q_0, EPSILON, offset2 + fa2->initial_state);
+
+  faBuilder.copy(*fa1, 0);
+  faBuilder.copy(*fa2, offset2);
 
-  for (size_t i = 0; i < fa1->symbols.size(); ++i) {
+  for (const state_type& f : fa1->final_states)
 
-    const symbol_type symbol = fa1->symbols[i];
+    faBuilder.final_state(f);
 
-    for (const std::pair<state_type, state_type>& pair : fa1->transitions[i]) {
+  for (const state_type& f : fa2->final_states)
 
-      faBuilder.transition(p1(pair.first), symbol, p1(pair.second));
-    }
-  }
+    faBuilder.final_state(offset2 + f);
+
+  return faBuilder.build();
+}
+
+/* A new initial state is needed: making fa1's own initial state final would
+ * also accept any string which merely returns to it.
+ */
+std::unique_ptr<FA> FA::repeat     (std::unique_ptr<FA> fa1) {
+
+  FABuilder faBuilder;
+
+  const state_type q_0 = fa1->state_count;
+
+  faBuilder.initial_state(q_0);
+  faBuilder.final_state(q_0);
+  faBuilder.transition(q_0, EPSILON, fa1->initial_state);
+
+  faBuilder.copy(*fa1, 0);
 
   for (const state_type& f : fa1->final_states)
 
-    faBuilder.transition(p1(f), EPSILON, p2(fa2->initial_state));
+    faBuilder.transition(f, EPSILON, q_0);
 
-  for (size_t i = 0; i < fa2->symbols.size(); ++i) {
+  return faBuilder.build();
+}
+
+/**
+ * Returns a normalized FA which is functionally identical to fa1.
+ *
+ * A normalized FA is an NFA with the minimim possible number of states.
+ * 
+ * @param  fa1 The FA.
+ * @return     A normalized FA.
+ */
+std::unique_ptr<FA> FA::normalize  (std::unique_ptr<FA> fa1) {
+
+  return normalize(std::move(fa1), ThreadPool::shared());
+}
+
+/**
+ * As above, but an NFA is determinized on the threads of pool rather than
+ * those of ThreadPool::shared().
+ *
+ * @param  fa1  The FA.
+ * @param  pool The threads to use.
+ * @return      A normalized FA.
+ */
+std::unique_ptr<FA> FA::normalize  (std::unique_ptr<FA> fa1, ThreadPool& pool) {
+
+  return fa1->normalize(pool);
+}
+
+size_t FA::countStates(
+  const state_type& initial_state,
+  const std::vector<state_type>& final_states,
+  const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions) {
+
+  state_type maxState = initial_state;
+
+  for (const state_type& f : final_states)
+
+    maxState = std::max(maxState, f);
+
+  for (const std::vector<std::pair<state_type, state_type>>& pairs : transitions)
+
+    for (const std::pair<state_type, state_type>& pair : pairs)
+
+      maxState = std::max(maxState, std::max(pair.first, pair.second));
+
+  return static_cast<size_t>(maxState) + 1;
+}
+
+/**
+ * Finds a literal string which every string the FA accepts contains.
+ *
+ * Add an exit state, reached from every final state. The states which every
+ * accepting path passes through are then the exit's dominators, which form a
+ * chain from the initial state; they are found with the iterative algorithm
+ * of Cooper, Harvey and Kennedy. A dominator which is not final and has only
+ * one transition (ignoring dead states) must be left by that transition, and
+ * it leads to the next dominator. So every accepting path spells out the
+ * symbols along a run of such dominators, and the longest run is the literal.
+ * A run can also start with the symbol on every transition into its first
+ * state, when there is only one, as in Glushkov automata.
+ *
+ * @param  initial_state The FA's initial state.
+ * @param  final_states  Its final states.
+ * @param  symbols       Its symbols.
+ * @param  transitions   Its transitions, by symbol.
+ * @param  state_count   Its number of states.
+ * @return               The literal, which is empty if none was found.
+ */
+FA::Literal FA::requiredLiteral(
+  const state_type& initial_state,
+  const std::vector<state_type>& final_states,
+  const std::vector<symbol_type>& symbols,
+  const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions,
+  const size_t& state_count) {
 
-    const symbol_type symbol = fa2->symbols[i];
+  const state_type exit = state_count;
+  const size_t     NONE = static_cast<size_t>(-1);
 
-    for (const std::pair<state_type, state_type>& pair : fa2->transitions[i]) {
+  std::vector<std::vector<std::pair<symbol_type, state_type>>> out(state_count + 1);
+  std::vector<std::vector<state_type>> in(state_count + 1);
 
-      faBuilder.transition(p2(pair.first), symbol, p2(pair.second));
+  /* The symbol on every transition into each state, if they all agree, as
+   * an unsigned char so that the sentinels cannot be taken for a symbol.
+   */
+  const int UNSET = 256, MIXED = 257;
+
+  std::vector<int> entry(state_count, UNSET);
+
+  for (size_t i = 0; i < symbols.size(); ++i)
+
+    for (const std::pair<state_type, state_type>& pair : transitions[i]) {
+
+      out[pair.first].emplace_back(symbols[i], pair.second);
+      in[pair.second].push_back(pair.first);
+
+      const int symbol = static_cast<unsigned char>(symbols[i]);
+
+      int& e = entry[pair.second];
+
+      e = (symbols[i] == EPSILON || (e != UNSET && e != symbol)) ?
+        MIXED : symbol;
     }
+
+  std::vector<char> isFinal(state_count, false);
+
+  for (const state_type& f : final_states) {
+
+    isFinal[f] = true;
+    in[exit].push_back(f);
   }
 
-  for (const state_type& f : fa2->final_states)
+  /* Only states from which the exit can be reached matter. */
+  std::vector<char> live(state_count + 1, false);
+  std::vector<state_type> stack {exit};
 
-    faBuilder.final_state(p2(f));
+  live[exit] = true;
 
-  return faBuilder.build();
-}
+  while (!stack.empty()) {
 
-std::unique_ptr<FA> FA::alternate  (std::unique_ptr<FA> fa1, 
-                                    std::unique_ptr<FA> fa2) {
+    const state_type q = stack.back();
 
-  FABuilder faBuilder;
+    stack.pop_back();
 
-  std::string q_0 = "ALT1_2";
-  faBuilder.initial_state(q_0);
-  faBuilder.transition(q_0, EPSILON, p1(fa1->initial_state));
-  faBuilder.transition(q_0, EPSILON, p2(fa2->initial_state));
+    for (const state_type& p : in[q])
 
-  for (size_t i = 0; i < fa1->symbols.size(); ++i) {
+      if (!live[p]) {
 
-    const symbol_type symbol = fa1->symbols[i];
+        live[p] = true;
+        stack.push_back(p);
+      }
+  }
 
-    for (const std::pair<state_type, state_type>& pair : fa1->transitions[i]) {
+  if (!live[initial_state])
 
-      const state_type startState = pair.first;
-      const state_type endState   = pair.second;
+    return {"", false};
+
+  for (size_t q = 0; q < state_count; ++q) {
+
+    std::vector<std::pair<symbol_type, state_type>>& edges = out[q];
+
+    edges.erase(std::remove_if(std::begin(edges), std::end(edges),
+                  [&live](const std::pair<symbol_type, state_type>& edge) {
+
+                    return !live[edge.second];
+                  }),
+                std::end(edges));
+
+    if (isFinal[q])
+
+      edges.emplace_back(EPSILON, exit);
+  }
+
+  /* Number the states reachable from the initial state in postorder. */
+  std::vector<size_t> postorder(state_count + 1, NONE);
+  std::vector<state_type> order;
+  std::vector<std::pair<state_type, size_t>> path {{initial_state, 0}};
+
+  postorder[initial_state] = 0;
+
+  while (!path.empty()) {
+
+    const state_type q = path.back().first;
 
-      faBuilder.transition(p1(startState), symbol, p1(endState));
+    if (path.back().second == out[q].size()) {
+
+      postorder[q] = order.size();
+      order.push_back(q);
+      path.pop_back();
+
+      continue;
+    }
+
+    const state_type next = out[q][path.back().second++].second;
+
+    if (postorder[next] == NONE) {
+
+      postorder[next] = 0;
+      path.emplace_back(next, 0);
     }
   }
 
-  for (size_t i = 0; i < fa2->symbols.size(); ++i) {
+  std::vector<state_type> idom(state_count + 1);
+  std::vector<char> done(state_count + 1, false);
 
-    const symbol_type symbol = fa2->symbols[i];
+  idom[initial_state] = initial_state;
+  done[initial_state] = true;
 
-    for (const std::pair<state_type, state_type>& pair : fa2->transitions[i]) {
+  for (bool changed = true; changed; ) {
 
-      const state_type startState = pair.first;
-      const state_type endState   = pair.second;
+    changed = false;
+
+    for (size_t i = order.size() - 1; i-- > 0; ) {
+
+      const state_type q = order[i];
+
+      state_type newIdom = q;
+
+      for (const state_type& p : in[q]) {
+
+        if (!done[p] || !live[p]) continue;
+
+        if (newIdom == q) {
+
+          newIdom = p;
+          continue;
+        }
+
+        state_type a = p, b = newIdom;
 
-      faBuilder.transition(p2(startState), symbol, p2(endState));
+        while (a != b) {
+
+          while (postorder[a] < postorder[b]) a = idom[a];
+          while (postorder[b] < postorder[a]) b = idom[b];
+        }
+
+        newIdom = a;
+      }
+
+      if (!done[q] || idom[q] != newIdom) {
+
+        idom[q] = newIdom;
+        done[q] = true;
+        changed = true;
+      }
     }
   }
 
-  for (const state_type& f : fa1->final_states)
+  std::vector<state_type> chain {exit};
 
-    faBuilder.final_state(p1(f));
+  for (state_type q = idom[exit]; q != initial_state; q = idom[q])
 
-  for (const state_type& f : fa2->final_states)
+    chain.push_back(q);
 
-    faBuilder.final_state(p2(f));
+  chain.push_back(initial_state);
 
-  return faBuilder.build();
+  std::reverse(std::begin(chain), std::end(chain));
+
+  Literal best {"", false};
+  Literal run {"", true};
+
+  for (size_t i = 0; i + 1 < chain.size(); ++i) {
+
+    const std::vector<std::pair<symbol_type, state_type>>& edges = out[chain[i]];
+
+    if (edges.size() == 1 && edges.front().second == chain[i + 1] &&
+        edges.front().second != exit) {
+
+      if (edges.front().first != EPSILON)
+
+        run.string += edges.front().first;
+
+      continue;
+    }
+
+    if (run.string.size() > best.string.size())
+
+      best = run;
+
+    /* The next run can also begin with the symbol which leads into it. */
+    const state_type next = chain[i + 1];
+
+    run = {"", false};
+
+    if (next != exit && entry[next] != UNSET && entry[next] != MIXED)
+
+      run.string += static_cast<symbol_type>(entry[next]);
+  }
+
+  return best;
 }
 
-std::unique_ptr<FA> FA::repeat     (std::unique_ptr<FA> fa1) {
+/**
+ * Finds the strings of symbols which accepted strings can start with.
+ *
+ * The FA is run on every string of length 1, 2 and so on, keeping those
+ * which some state can still be reached by. This stops before a final state
+ * is reached, since shorter strings would then be accepted too, before
+ * Teddy::MAX_LENGTH, or before there are more than Teddy::MAX_STRINGS.
+ *
+ * @param  initial_state The FA's initial state.
+ * @param  final_states  Its final states.
+ * @param  symbols       Its symbols.
+ * @param  transitions   Its transitions, by symbol.
+ * @param  state_count   Its number of states.
+ * @return               A Teddy for the longest such strings, or an empty one.
+ */
+Teddy FA::startPrefixes(
+  const state_type& initial_state,
+  const std::vector<state_type>& final_states,
+  const std::vector<symbol_type>& symbols,
+  const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions,
+  const size_t& state_count) {
 
-  FABuilder faBuilder;
+  std::vector<std::vector<std::pair<symbol_type, state_type>>> out(state_count);
 
-  faBuilder.initial_state(p1(fa1->initial_state));
-  faBuilder.final_state(p1(fa1->initial_state));
+  for (size_t i = 0; i < symbols.size(); ++i)
 
-  for (size_t i = 0; i < fa1->symbols.size(); ++i) {
+    for (const std::pair<state_type, state_type>& pair : transitions[i])
 
-    const symbol_type symbol = fa1->symbols[i];
+      out[pair.first].emplace_back(symbols[i], pair.second);
 
-    for (const std::pair<state_type, state_type>& pair : fa1->transitions[i]) {
+  std::vector<char> isFinal(state_count, false);
 
-      const state_type startState = pair.first;
-      const state_type endState   = pair.second;
+  for (const state_type& f : final_states)
+
+    isFinal[f] = true;
+
+  /* Adds every state reachable by EPSILON to states, whose own states have
+   * to be marked seen. Returns true if any of them are final.
+   */
+  std::vector<char> seen(state_count, false);
+
+  auto close = [&](std::vector<state_type>& states) {
+
+    bool accepts = false;
+
+    for (size_t i = 0; i < states.size(); ++i) {
+
+      accepts = accepts || isFinal[states[i]];
+
+      for (const std::pair<symbol_type, state_type>& edge : out[states[i]])
+
+        if (edge.first == EPSILON && !seen[edge.second]) {
+
+          seen[edge.second] = true;
+          states.push_back(edge.second);
+        }
+    }
+
+    for (const state_type& q : states)
+
+      seen[q] = false;
+
+    return accepts;
+  };
 
-      faBuilder.transition(p1(startState), symbol, p1(endState));
+  std::map<std::string, std::vector<state_type>> level {{"", {initial_state}}};
+
+  seen[initial_state] = true;
+
+  if (close(level.begin()->second))
+
+    return Teddy();
+
+  for (size_t length = 0; length < Teddy::MAX_LENGTH; ++length) {
+
+    std::map<std::string, std::vector<state_type>> next;
+
+    for (const std::pair<const std::string, std::vector<state_type>>& entry : level)
+
+      for (const state_type& q : entry.second)
+
+        for (const std::pair<symbol_type, state_type>& edge : out[q])
+
+          if (edge.first != EPSILON)
+
+            next[entry.first + edge.first].push_back(edge.second);
+
+    if (next.empty() || next.size() > Teddy::MAX_STRINGS) break;
+
+    bool accepts = false;
+
+    for (std::pair<const std::string, std::vector<state_type>>& entry : next) {
+
+      std::vector<state_type>& states = entry.second;
+
+      std::sort(std::begin(states), std::end(states));
+
+      states.erase(std::unique(std::begin(states), std::end(states)),
+                   std::end(states));
+
+      for (const state_type& q : states)
+
+        seen[q] = true;
+
+      accepts = close(states) || accepts;
     }
+
+    level = std::move(next);
+
+    if (accepts) break;
   }
 
-  for (const state_type& f : fa1->final_states)
+  if (level.begin()->first.empty())
 
-    faBuilder.transition(p1(f), EPSILON, p1(fa1->initial_state));
+    return Teddy();
 
-  return faBuilder.build();
+  std::vector<std::string> strings;
+
+  for (const std::pair<const std::string, std::vector<state_type>>& entry : level)
+
+    strings.push_back(entry.first);
+
+  return Teddy(strings);
+}
+
+const FA::Prefilter& FA::searchPrefilter() const {
+
+  Prefilter& filter = *prefilter;
+
+  std::call_once(filter.built, [&]() {
+
+    filter.literal = requiredLiteral(initial_state, final_states, symbols,
+                                     transitions, state_count);
+    filter.prefixes = startPrefixes(initial_state, final_states, symbols,
+                                    transitions, state_count);
+  });
+
+  return filter;
+}
+
+/* memchr finds candidates for the literal's first symbol much faster than a
+ * byte at a time; memcmp checks the rest.
+ */
+const char* FA::nextLiteral(const char* first, const char* last) const {
+
+  const std::string& string = searchPrefilter().literal.string;
+
+  if (string.empty()) return first;
+
+  while (static_cast<size_t>(last - first) >= string.size()) {
+
+    const char* candidate = static_cast<const char*>(
+      std::memchr(first, string.front(), last - first - string.size() + 1));
+
+    if (!candidate) break;
+
+    if (std::memcmp(candidate + 1, string.data() + 1, string.size() - 1) == 0)
+
+      return candidate;
+
+    first = candidate + 1;
+  }
+
+  return last;
+}
+
+const char* FA::nextPrefix(const char* first, const char* last) const {
+
+  return searchPrefilter().prefixes.find(first, last);
+}
+
+std::string::const_iterator FA::nextPrefix(
+  std::string::const_iterator first,
+  std::string::const_iterator last) const {
+
+  if (first == last) return last;
+
+  const char* arr = &*first;
+
+  return first + (nextPrefix(arr, arr + (last - first)) - arr);
+}
+
+std::string::const_iterator FA::nextLiteral(
+  std::string::const_iterator first,
+  std::string::const_iterator last) const {
+
+  if (first == last) return last;
+
+  const char* arr = &*first;
+
+  return first + (nextLiteral(arr, arr + (last - first)) - arr);
+}
+
+size_t FA::StateSetHash::operator () (
+  const std::vector<state_type>& states) const {
+
+  size_t hash = states.size();
+
+  for (const state_type& q : states)
+
+    hash ^= q + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+
+  return hash;
 }
 
 /**
- * Returns a normalized FA which is functionally identical to fa1.
+ * Finds every non-overlapping substring of the input which the FA accepts.
  *
- * A normalized FA is an NFA with the minimim possible number of states.
- * 
- * @param  fa1 The FA.
- * @return     A normalized FA.
+ * @param  arr       The input.
+ * @param  n         Its length.
+ * @param  semantics Which of several overlapping matches to report.
+ * @return           A range of the matches' bounds, from left to right.
  */
-std::unique_ptr<FA> FA::normalize  (std::unique_ptr<FA> fa1) {
+FA::Matches<const char*> FA::findAll( const char* arr, const size_t& n,
+                                      const MatchSemantics& semantics) const {
+
+  return Matches<const char*>(this, arr, arr + n, semantics);
+}
+
+FA::Matches<std::string::const_iterator>
+  FA::findAll(std::string::const_iterator first,
+              std::string::const_iterator last,
+              const MatchSemantics& semantics) const {
 
-  return fa1->normalize();
+  return Matches<std::string::const_iterator>(this, first, last, semantics);
+}
+
+MatchStatus FA::matchStatusParallel(const char* arr, const size_t& n,
+                                    ThreadPool&) const {
+
+  return matchStatus(arr, n);
+}
+
+std::vector<bool> FA::matchBatch(const std::vector<std::string>& strings) const {
+
+  return matchBatch(strings, ThreadPool::shared());
+}
+
+/**
+ * Matches each of a batch of strings, spread across a pool's threads.
+ *
+ * @param  strings The strings.
+ * @param  pool    The threads to use.
+ * @return         Element i is true if the FA accepts strings[i].
+ */
+std::vector<bool> FA::matchBatch(const std::vector<std::string>& strings,
+                                 ThreadPool& pool) const {
+
+  /* Strings per range handed to a thread. */
+  const size_t GRAIN = 256;
+
+  /* Threads cannot safely write neighbouring bits of a vector<bool>. */
+  std::vector<char> matched(strings.size());
+
+  pool.parallelFor(strings.size(), GRAIN,
+                   [&] (const size_t& first, const size_t& last) {
+
+                     for (size_t i = first; i < last; ++i)
+
+                       matched[i] = match(strings[i].data(), strings[i].size());
+                   });
+
+  return std::vector<bool>(std::begin(matched), std::end(matched));
+}
+
+bool FA::isFinal(const state_type& q) const {
+
+  return std::binary_search(std::begin(final_states), std::end(final_states), q);
+}
+
+/**
+ * Returns an FA which is functionally identical to fa1, and which is
+ * determinized lazily as it matches.
+ *
+ * This avoids building the whole DFA up front, which can take exponential
+ * time and space for some FAs. See LazyDFA.
+ *
+ * @param  fa1        The FA.
+ * @param  cacheBytes Roughly how much memory to spend on cached DFA states.
+ * @return            A lazily determinized FA.
+ */
+std::unique_ptr<FA> FA::lazy(std::unique_ptr<FA> fa1, const size_t& cacheBytes) {
+
+  return std::unique_ptr<FA>(new LazyDFA(*fa1, cacheBytes));
 }
 
 /**
@@ -177,6 +667,11 @@ std::set<FA::state_type> FA::findDeadStates() const {
 
     stateStack.clear();
 
+    /* Every state can reach itself, including states which have no outgoing
+     * transitions and were only added to the map during the search below.
+     */
+    pair.second.insert(pair.first);
+
     stateStack.push_back(pair.first);
 
     std::copy(std::begin(pair.second), std::end(pair.second),
@@ -251,7 +746,7 @@ std::unique_ptr<FA> FA::removeDeadStates()  const {
     return std::binary_search(std::begin(deadStates), std::end(deadStates), q);
   };
 
-  faBuilder.initial_state(std::to_string(initial_state));
+  faBuilder.initial_state(initial_state);
 
   /* If the initial_state is a dead state, then we're done. Nothing else
    * matters.
@@ -271,8 +766,7 @@ std::unique_ptr<FA> FA::removeDeadStates()  const {
 
       if (!isDead(startState) and !isDead(endState))
 
-        faBuilder.transition( std::to_string(startState), symbol, 
-                              std::to_string(endState));
+        faBuilder.transition(startState, symbol, endState);
     }
   }
 
@@ -280,7 +774,7 @@ std::unique_ptr<FA> FA::removeDeadStates()  const {
 
     if (!isDead(final_state))
 
-      faBuilder.final_state(std::to_string(final_state));
+      faBuilder.final_state(final_state);
   }
 
   return faBuilder.build();
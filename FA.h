@@ -1,13 +1,57 @@
 #pragma once
 
+#include "Teddy.h"
+
 #include <string>
+#include <iosfwd>
 #include <vector>
 #include <set>
 #include <utility>
 #include <memory>
+#include <array>
+#include <bitset>
+#include <iterator>
+#include <cstddef>
+#include <mutex>
 
 const char EPSILON = '\0';
 
+/* Why a call to FA::matchStatus did or did not accept its input. */
+enum class MatchStatus {
+
+  MATCH,      // The input ended in a final state.
+  NO_MATCH,   // The input ended in a state which is not final.
+  DEAD_STATE  // A transition was missing, so no longer input can match.
+};
+
+/* How FA::fromRegex turns a regex into an automaton. */
+enum class Construction {
+
+  THOMPSON, // An NFA with EPSILON transitions, linear in the regex's length.
+  GLUSHKOV  // An NFA without EPSILON transitions, with one state per symbol.
+};
+
+/* Which substring FA::findAll reports when several overlapping ones are
+ * accepted. Either way, the match which starts first wins; the automata keep
+ * no priorities between alternatives, so they differ only in where it ends.
+ */
+enum class MatchSemantics {
+
+  LEFTMOST_SHORTEST, // At the first final state reached.
+  LEFTMOST_LONGEST   // At the last final state reached, as in POSIX.
+};
+
+class ThreadPool;
+
+/**
+ * A finite automaton, as built by fromRegex and the combinators below.
+ *
+ * An FA is never changed once it has been built: every const member function
+ * may be called from any number of threads at once on one shared FA. The
+ * Pike VM keeps its working sets per thread, and the lazily built parts (the
+ * search prefilter, a DFA's search automata, a LazyDFA's cache) are guarded
+ * internally.
+ */
 class FA {
 
 public:
@@ -15,50 +59,315 @@ public:
   typedef char     symbol_type;
   typedef unsigned state_type;
 
+  /* A set of symbols, indexed by their values as unsigned chars. */
+  typedef std::bitset<256> symbol_set_type;
+
   FA() = delete;
 
   FA(const FA&) = default;
 
+  virtual ~FA() = default;
+
   virtual bool match (const char*, const size_t&) const = 0;
 
   virtual bool match( std::string::const_iterator,
                       std::string::const_iterator) const = 0;
 
+  virtual MatchStatus matchStatus(const char*, const size_t&) const = 0;
+
   virtual std::pair<const char*, const size_t> findNext(const char*, 
                                                         const size_t&) const = 0;
 
   virtual std::pair<std::string::const_iterator, std::string::const_iterator>
     findNext(std::string::const_iterator, std::string::const_iterator) const = 0;
 
+  template <typename InputIterator>
+  class Matches;
+
+  Matches<const char*> findAll(const char*, const size_t&,
+                               const MatchSemantics& =
+                                 MatchSemantics::LEFTMOST_LONGEST) const;
+
+  Matches<std::string::const_iterator>
+    findAll(std::string::const_iterator, std::string::const_iterator,
+            const MatchSemantics& = MatchSemantics::LEFTMOST_LONGEST) const;
+
+  /* Matches one long input, split up among a pool's threads. Only a DFA can
+   * split it; other automata match it on the calling thread.
+   */
+  virtual MatchStatus matchStatusParallel(const char*, const size_t&,
+                                          ThreadPool&) const;
+
+  /* Matches many strings at once, on ThreadPool::shared() by default. */
+  std::vector<bool> matchBatch(const std::vector<std::string>&) const;
+  std::vector<bool> matchBatch(const std::vector<std::string>&,
+                               ThreadPool&) const;
+
   static std::unique_ptr<FA> concatenate(std::unique_ptr<FA>, std::unique_ptr<FA>);
   static std::unique_ptr<FA> alternate  (std::unique_ptr<FA>, std::unique_ptr<FA>);
   static std::unique_ptr<FA> repeat     (std::unique_ptr<FA>);
   static std::unique_ptr<FA> normalize  (std::unique_ptr<FA>);
+  static std::unique_ptr<FA> normalize  (std::unique_ptr<FA>, ThreadPool&);
+  static std::unique_ptr<FA> lazy       (std::unique_ptr<FA>,
+                                         const size_t& cacheBytes = 1 << 20);
+
+  static std::unique_ptr<FA> fromRegex  (const std::string&,
+                                         const Construction& =
+                                           Construction::THOMPSON);
+
+  /* Compiled FAs can be saved and loaded again. See FAFormat. */
+          void               save       (std::ostream&) const;
+  static std::unique_ptr<FA> load       (const char*, const size_t&);
+
+  /* Maps every input byte to an equivalence class. Bytes in the same class
+   * have identical transitions from every state of the FA, so tables only
+   * need one column per class. Class 0 always holds the bytes which have no
+   * transitions at all (including EPSILON).
+   */
+  struct ByteClasses {
 
-  static std::unique_ptr<FA> fromRegex  (const std::string&);
+    std::array<unsigned char, 256> classOf;
+    size_t count;
+  };
 
   friend class FABuilder;
+  friend class StreamMatcher;
+  friend class LazyDFA;
+  friend class RegexSet;
+  friend class CodeGenerator;
 
 protected:
 
   FA( const state_type& initial_state,
       const std::vector<state_type>& final_states,
       const std::vector<symbol_type>& symbols,
-      const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions) :
+      const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions,
+      const ByteClasses& byte_classes) :
     initial_state(initial_state),
     final_states(final_states),
     symbols(symbols),
-    transitions(transitions) {}
+    transitions(transitions),
+    state_count(countStates(initial_state, final_states, transitions)),
+    byte_classes(byte_classes),
+    prefilter(std::make_shared<Prefilter>()) {}
 
   const state_type initial_state;
   const std::vector<state_type> final_states;
   const std::vector<symbol_type> symbols;
   const std::vector<std::vector<std::pair<state_type, state_type>>> transitions;
 
+  /* One more than the largest state mentioned anywhere in the FA, so that
+   * every state can be used directly as an index.
+   */
+  const size_t state_count;
+
+  const ByteClasses byte_classes;
+
+  /* A string which every string the FA accepts contains, so that searches
+   * can skip input without it. It is empty if there is no such string.
+   */
+  struct Literal {
+
+    std::string string;
+    bool prefix; // Whether every accepted string also starts with it.
+  };
+
+  /* What searches use to skip input which cannot be part of a match. It is
+   * built the first time the FA searches, since most FAs are only steps on
+   * the way to another one, and it is shared by copies of the FA.
+   *
+   * A literal which is a prefix lets a search jump to each place it occurs.
+   * One inside the accepted strings only stops the search early, once it
+   * cannot occur again; until then the search still reads every symbol,
+   * since a match may start any distance before it.
+   */
+  struct Prefilter {
+
+    std::once_flag built;
+
+    Literal literal;
+
+    /* Finds where accepted strings might start, by their first few symbols.
+     * It is empty if they cannot be told apart that way.
+     */
+    Teddy prefixes;
+  };
+
+  const Prefilter& searchPrefilter() const;
+
+  static size_t countStates(
+    const state_type& initial_state,
+    const std::vector<state_type>& final_states,
+    const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions);
+
+  static Literal requiredLiteral(
+    const state_type& initial_state,
+    const std::vector<state_type>& final_states,
+    const std::vector<symbol_type>& symbols,
+    const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions,
+    const size_t& state_count);
+
+  static Teddy startPrefixes(
+    const state_type& initial_state,
+    const std::vector<state_type>& final_states,
+    const std::vector<symbol_type>& symbols,
+    const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions,
+    const size_t& state_count);
+
+  /* The first occurrence of the literal in [first, last), or last. */
+  const char* nextLiteral(const char*, const char*) const;
+  std::string::const_iterator nextLiteral(std::string::const_iterator,
+                                          std::string::const_iterator) const;
+
+  /* The first place in [first, last) where prefixes might start, or last. */
+  const char* nextPrefix(const char*, const char*) const;
+  std::string::const_iterator nextPrefix(std::string::const_iterator,
+                                         std::string::const_iterator) const;
+
+  /* Hashes a sorted vector of states, so that sets of NFA states can be used
+   * as keys when they become the states of a DFA.
+   */
+  struct StateSetHash {
+
+    size_t operator () (const std::vector<state_type>&) const;
+  };
+
+  /* Single-state stepping, so that many independent threads can be run
+   * through one FA at once. Both functions append epsilon-closed states to
+   * their output and never clear it.
+   */
+  virtual void startStates(std::vector<state_type>&) const = 0;
+  virtual void step(const state_type&, const symbol_type&,
+                    std::vector<state_type>&) const = 0;
+
+  /* Finds the leftmost match in [first, last), or returns {last, last}. */
+  virtual std::pair<const char*, const char*>
+    find(const char*, const char*, const MatchSemantics&) const = 0;
+  virtual std::pair<std::string::const_iterator, std::string::const_iterator>
+    find( std::string::const_iterator, std::string::const_iterator,
+          const MatchSemantics&) const = 0;
+
+          bool isFinal(const state_type&) const;
+
           std::set<state_type> findDeadStates()   const;
   virtual std::unique_ptr<FA>  removeDeadStates() const;
 
 private:
 
-  virtual std::unique_ptr<FA>  normalize()        const = 0;
+  virtual std::unique_ptr<FA>  normalize(ThreadPool&) const = 0;
+
+  std::shared_ptr<Prefilter> prefilter;
+};
+
+/**
+ * The non-overlapping matches in a string, from left to right, as returned by
+ * FA::findAll. Each match is found when the iterator reaches it, by searching
+ * from the end of the one before; an empty match is stepped over by one
+ * symbol, so that the search always moves forward.
+ */
+template <typename InputIterator>
+class FA::Matches {
+
+public:
+
+  typedef std::pair<InputIterator, InputIterator> value_type;
+
+  class iterator {
+
+  public:
+
+    typedef std::input_iterator_tag iterator_category;
+    typedef Matches::value_type     value_type;
+    typedef std::ptrdiff_t          difference_type;
+    typedef const value_type*       pointer;
+    typedef const value_type&       reference;
+
+    iterator() :
+      range(nullptr) {}
+
+    reference operator * () const { return match; }
+    pointer   operator -> () const { return &match; }
+
+    iterator& operator ++ () {
+
+      InputIterator next = match.second;
+
+      if (next == match.first) ++next;
+
+      find(next);
+
+      return *this;
+    }
+
+    iterator operator ++ (int) {
+
+      iterator old(*this);
+
+      ++*this;
+
+      return old;
+    }
+
+    bool operator == (const iterator& other) const {
+
+      if (!range || !other.range)
+
+        return range == other.range;
+
+      return match == other.match;
+    }
+
+    bool operator != (const iterator& other) const {
+
+      return !(*this == other);
+    }
+
+    friend class Matches;
+
+  private:
+
+    explicit iterator(const Matches* range) :
+      range(range) {
+
+      find(range->first);
+    }
+
+    /* Becomes the end iterator if there are no more matches. */
+    void find(InputIterator from) {
+
+      if (from == range->last) {
+
+        range = nullptr;
+        return;
+      }
+
+      match = range->fa->find(from, range->last, range->semantics);
+
+      if (match.first == range->last)
+
+        range = nullptr;
+    }
+
+    const Matches* range;
+    value_type match;
+  };
+
+  iterator begin() const { return iterator(this); }
+  iterator end()   const { return iterator(); }
+
+  friend class FA;
+
+private:
+
+  Matches(const FA* fa, InputIterator first, InputIterator last,
+          const MatchSemantics& semantics) :
+    fa(fa),
+    first(first),
+    last(last),
+    semantics(semantics) {}
+
+  const FA* fa;
+  InputIterator first;
+  InputIterator last;
+  MatchSemantics semantics;
 };
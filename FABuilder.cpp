@@ -6,19 +6,13 @@
 #include <map>
 #include <vector>
 #include <utility>
+#include <limits>
 #include <algorithm>
 #include <iterator>
 
-bool operator < (const Transition& a, const Transition& b) {
-
-  return a.start < b.start ? true :
-    a.symbol < b.symbol ? true :
-      a.end < b.end;
-}
-
 FABuilder& FABuilder::initial_state(const std::string& state) {
 
-  _initial_state = state;
+  _initial_state = intern(state);
 
   return *this;
 }
@@ -27,106 +21,209 @@ FABuilder& FABuilder::transition( const std::string& start,
                                   const FA::symbol_type& symbol,
                                   const std::string& end) {
 
-  _transitions.insert({start, symbol, end});
+  const FA::state_type q = intern(start);
+  const FA::state_type r = intern(end);
+
+  _adjacency[q].emplace_back(symbol, r);
 
   return *this;
 }
 
 FABuilder& FABuilder::final_state(const std::string& state) {
 
-  _final_states.insert(state);
+  _final_states[intern(state)] = true;
+
+  return *this;
+}
+
+FABuilder& FABuilder::initial_state(const FA::state_type& state) {
+
+  _initial_state = intern(state);
+
+  return *this;
+}
+
+FABuilder& FABuilder::transition( const FA::state_type& start,
+                                  const FA::symbol_type& symbol,
+                                  const FA::state_type& end) {
+
+  const FA::state_type q = intern(start);
+  const FA::state_type r = intern(end);
+
+  _adjacency[q].emplace_back(symbol, r);
+
+  return *this;
+}
+
+/**
+ * Adds a transition on every symbol in a set, except EPSILON.
+ *
+ * The transitions cost one entry per symbol here, but symbols which always
+ * go together end up in one byte class, so the FA's tables stay small.
+ *
+ * @param  start   The state to move from.
+ * @param  symbols The symbols to move on.
+ * @param  end     The state to move to.
+ * @return         This FABuilder.
+ */
+FABuilder& FABuilder::transition( const FA::state_type& start,
+                                  const FA::symbol_set_type& symbols,
+                                  const FA::state_type& end) {
+
+  const FA::state_type q = intern(start);
+  const FA::state_type r = intern(end);
+
+  for (size_t c = 1; c < symbols.size(); ++c)
+
+    if (symbols[c])
+
+      _adjacency[q].emplace_back(static_cast<FA::symbol_type>(c), r);
+
+  return *this;
+}
+
+FABuilder& FABuilder::final_state(const FA::state_type& state) {
+
+  _final_states[intern(state)] = true;
+
+  return *this;
+}
+
+/**
+ * Adds every transition of an FA, with its states shifted by an offset.
+ *
+ * Only the transitions are copied, so that combinators can choose their own
+ * initial and final states.
+ *
+ * @param  fa     The FA.
+ * @param  offset The number added to each of its states.
+ * @return        This FABuilder.
+ */
+FABuilder& FABuilder::copy(const FA& fa, const FA::state_type& offset) {
+
+  for (size_t i = 0; i < fa.symbols.size(); ++i) {
+
+    const FA::symbol_type symbol = fa.symbols[i];
+
+    for (const std::pair<FA::state_type, FA::state_type>& pair : fa.transitions[i])
+
+      transition(offset + pair.first, symbol, offset + pair.second);
+  }
 
   return *this;
 }
 
-std::vector<std::string> enumerateStates( const std::string& initial_state,
-                                          const std::set<Transition>& transitions) {
+FA::state_type FABuilder::intern(const std::string& state) {
 
-  std::vector<std::string> states {initial_state};
-  size_t currState = 0;
+  auto inserted = _names.emplace(state, _adjacency.size());
 
-  while (currState != states.size()) {
+  if (inserted.second) {
 
-    for (const Transition& transition : transitions)
+    _adjacency.emplace_back();
+    _final_states.push_back(false);
+  }
 
-      if (transition.start == states[currState])
+  return inserted.first->second;
+}
 
-        if (std::find(std::begin(states), std::begin(states) + currState + 1, 
-                      transition.end) ==  std::begin(states) + currState + 1)
+FA::state_type FABuilder::intern(const FA::state_type& state) {
 
-          states.push_back(transition.end);
+  auto inserted = _ids.emplace(state, _adjacency.size());
 
-    ++currState;
+  if (inserted.second) {
+
+    _adjacency.emplace_back();
+    _final_states.push_back(false);
   }
 
-  return states;
+  return inserted.first->second;
 }
 
+/**
+ * Builds the FA.
+ *
+ * States are renumbered in breadth-first order from the initial state, which
+ * becomes state 0, and states which cannot be reached from it are left out.
+ * If initial_state was never called, the first state mentioned is initial.
+ *
+ * The result is a DFA if no state has an EPSILON transition or two
+ * transitions on the same symbol, and an NFA otherwise.
+ *
+ * @return The FA.
+ */
 std::unique_ptr<FA> FABuilder::build() const {
 
-  std::vector<char> sigma;
-  std::vector<std::vector<std::pair<FA::state_type, FA::state_type>>> delta;
+  const FA::state_type UNREACHED = static_cast<FA::state_type>(-1);
 
-  std::vector<std::string> states = enumerateStates(_initial_state, _transitions);
+  const size_t n = std::max(_adjacency.size(),
+                            static_cast<size_t>(_initial_state) + 1);
 
-  /* This should always be 0, but why not be safe? */
-  FA::state_type q_0 = std::distance( std::begin(states),
-                                      std::find(std::begin(states),
-                                      std::end(states),
-                                      _initial_state));
+  std::vector<FA::state_type> number(n, UNREACHED);
+  std::vector<FA::state_type> states {_initial_state};
 
-  std::vector<FA::state_type> f;
+  number[_initial_state] = 0;
+
+  for (size_t i = 0; i < states.size(); ++i) {
 
-  std::transform( std::begin(_final_states), std::end(_final_states),
-                  std::back_inserter(f),
-                  [&] (const std::string& state) -> FA::state_type {
+    if (states[i] >= _adjacency.size()) continue;
 
-                    return std::distance( std::begin(states),
-                                          std::find(std::begin(states),
-                                          std::end(states),
-                                          state));
-                  });
+    for (const std::pair<FA::symbol_type, FA::state_type>& edge :
+         _adjacency[states[i]]) {
 
-  std::sort(std::begin(f), std::end(f));
+      if (number[edge.second] == UNREACHED) {
 
-  std::transform( std::begin(_transitions), std::end(_transitions),
-                  std::back_inserter(sigma),
-                  [] (const Transition& transition) -> char {
+        number[edge.second] = states.size();
+        states.push_back(edge.second);
+      }
+    }
+  }
+
+  /* Transitions by symbol, indexed by the symbol as an unsigned char. */
+  std::vector<std::vector<std::pair<FA::state_type, FA::state_type>>> bySymbol(256);
+
+  std::vector<FA::state_type> f;
+
+  for (size_t i = 0; i < states.size(); ++i) {
 
-                    return transition.symbol;
-                  });
+    if (states[i] >= _adjacency.size()) continue;
 
-  std::sort(std::begin(sigma), std::end(sigma));
+    for (const std::pair<FA::symbol_type, FA::state_type>& edge :
+         _adjacency[states[i]])
 
-  sigma.erase(std::unique(std::begin(sigma), std::end(sigma)), std::end(sigma));
+      bySymbol[static_cast<unsigned char>(edge.first)].emplace_back(
+        i, number[edge.second]);
 
-  delta.resize(sigma.size());
+    if (_final_states[states[i]])
+
+      f.push_back(i);
+  }
+
+  std::vector<FA::symbol_type> sigma;
+  std::vector<std::vector<std::pair<FA::state_type, FA::state_type>>> delta;
 
-  for (const Transition& transition : _transitions)
+  for (int c = std::numeric_limits<FA::symbol_type>::min();
+       c <= std::numeric_limits<FA::symbol_type>::max(); ++c) {
 
-    delta[
-      std::distance(std::begin(sigma), 
-                    std::lower_bound( std::begin(sigma), 
-                                      std::end(sigma), 
-                                      transition.symbol))
-    ].emplace_back( std::distance(std::begin(states), 
-                                  std::find(std::begin(states), 
-                                            std::end(states), 
-                                            transition.start)), 
-                    std::distance(std::begin(states),
-                                  std::find(std::begin(states),
-                                            std::end(states),
-                                            transition.end)));
+    std::vector<std::pair<FA::state_type, FA::state_type>>& elem =
+      bySymbol[static_cast<unsigned char>(c)];
 
-  for (std::vector<std::pair<FA::state_type, FA::state_type>>& elem : delta)
+    if (elem.empty()) continue;
 
     std::sort(std::begin(elem), std::end(elem));
 
+    elem.erase(std::unique(std::begin(elem), std::end(elem)), std::end(elem));
+
+    sigma.push_back(static_cast<FA::symbol_type>(c));
+    delta.push_back(std::move(elem));
+  }
+
+  const FA::ByteClasses classes = byteClasses(sigma, delta);
+
   /* Determine if we have an NFA or a DFA */
 
   if (std::binary_search(std::begin(sigma), std::end(sigma), EPSILON)) {
 
-    return std::unique_ptr<FA>(new NFA(q_0, f, sigma, delta));
+    return std::unique_ptr<FA>(new NFA(0, f, sigma, delta, classes));
   }
 
   for (const std::vector<std::pair<FA::state_type, FA::state_type>>& elem : delta)
@@ -139,8 +236,48 @@ std::unique_ptr<FA> FABuilder::build() const {
                               return first.first == second.first;
                             }) != std::end(elem)) {
 
-      return std::unique_ptr<FA>(new NFA(q_0, f, sigma, delta));
+      return std::unique_ptr<FA>(new NFA(0, f, sigma, delta, classes));
+  }
+
+  return std::unique_ptr<FA>(new DFA(0, f, sigma, delta, classes));
+}
+
+/**
+ * Partitions the 256 byte values into equivalence classes.
+ *
+ * Two bytes are equivalent if they have exactly the same transitions, which
+ * is the case for every pair of bytes that never appears in sigma. Since each
+ * entry of delta is sorted, equivalent symbols have equal vectors.
+ *
+ * @param  sigma The sorted alphabet of the FA.
+ * @param  delta The sorted transitions on each symbol of sigma.
+ * @return       The byte-to-class map and the number of classes.
+ */
+FA::ByteClasses FABuilder::byteClasses(
+  const std::vector<FA::symbol_type>& sigma,
+  const std::vector<std::vector<std::pair<FA::state_type, FA::state_type>>>& delta) {
+
+  FA::ByteClasses classes;
+  std::map<std::vector<std::pair<FA::state_type, FA::state_type>>,
+           unsigned char> classOfTransitions;
+
+  classes.classOf.fill(0);
+  classes.count = 1;
+
+  classOfTransitions[{}] = 0;
+
+  for (size_t i = 0; i < sigma.size(); ++i) {
+
+    if (sigma[i] == EPSILON) continue;
+
+    auto it = classOfTransitions.find(delta[i]);
+
+    if (it == std::end(classOfTransitions))
+
+      it = classOfTransitions.emplace(delta[i], classes.count++).first;
+
+    classes.classOf[static_cast<unsigned char>(sigma[i])] = it->second;
   }
 
-  return std::unique_ptr<FA>(new DFA(q_0, f, sigma, delta));
+  return classes;
 }
@@ -3,18 +3,11 @@
 #include "FA.h"
 
 #include <string>
-#include <set>
+#include <vector>
+#include <unordered_map>
+#include <utility>
 #include <memory>
 
-struct Transition {
-
-  std::string start;
-  FA::symbol_type symbol;
-  std::string end;
-};
-
-bool operator < (const Transition&, const Transition&);
-
 class FABuilder {
 
 public:
@@ -28,11 +21,38 @@ public:
 
   FABuilder& final_state(const std::string&);
 
+  FABuilder& initial_state(const FA::state_type&);
+
+  FABuilder& transition(const FA::state_type&, const FA::symbol_type&,
+                        const FA::state_type&);
+
+  FABuilder& transition(const FA::state_type&, const FA::symbol_set_type&,
+                        const FA::state_type&);
+
+  FABuilder& final_state(const FA::state_type&);
+
+  FABuilder& copy(const FA&, const FA::state_type&);
+
   std::unique_ptr<FA> build() const;
 
+  static FA::ByteClasses byteClasses(
+    const std::vector<FA::symbol_type>&,
+    const std::vector<std::vector<std::pair<FA::state_type, FA::state_type>>>&);
+
 private:
 
-  std::string _initial_state;
-  std::set<Transition> _transitions;
-  std::set<std::string> _final_states;
+  FA::state_type intern(const std::string&);
+  FA::state_type intern(const FA::state_type&);
+
+  /* States are numbered densely in the order they are first mentioned. Names
+   * and integer states are kept apart, so "1" and 1 are different states.
+   */
+  std::unordered_map<std::string, FA::state_type>    _names;
+  std::unordered_map<FA::state_type, FA::state_type> _ids;
+
+  FA::state_type _initial_state = 0;
+
+  /* The transitions out of each state, which may contain duplicates. */
+  std::vector<std::vector<std::pair<FA::symbol_type, FA::state_type>>> _adjacency;
+  std::vector<char> _final_states;
 };
@@ -57,3 +57,14 @@ private:
 
   const std::string& regex;
 };
+
+class BadFormat :
+  public FAException {
+
+public:
+
+  virtual const char* what() const noexcept(true) {
+
+    return "Not a valid compiled automaton.";
+  }
+};
@@ -0,0 +1,287 @@
+#include "FAFormat.h"
+
+#include "DFA.h"
+#include "NFA.h"
+#include "FAExcept.h"
+
+#include <cstring>
+#include <ostream>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+
+const uint32_t FAFormat::MAGIC;
+const uint32_t FAFormat::VERSION;
+const size_t   FAFormat::CLASSES_OFFSET;
+const size_t   FAFormat::SYMBOLS_OFFSET;
+
+/* Rounds n up to a multiple of 4. */
+static uint64_t pad(const uint64_t& n) {
+
+  return (n + 3) & ~static_cast<uint64_t>(3);
+}
+
+uint32_t FAFormat::read(const unsigned char* p) {
+
+  return static_cast<uint32_t>(p[0])       |
+         static_cast<uint32_t>(p[1]) << 8  |
+         static_cast<uint32_t>(p[2]) << 16 |
+         static_cast<uint32_t>(p[3]) << 24;
+}
+
+void FAFormat::write(std::string& out, const uint32_t& n) {
+
+  for (size_t i = 0; i < 4; ++i)
+
+    out += static_cast<char>((n >> (8 * i)) & 0xff);
+}
+
+/**
+ * Reads and checks the header of a compiled automaton.
+ *
+ * The sizes and offsets in the header are checked against each other and
+ * against the length of the data, as are the byte classes, so every part can
+ * be read without going out of bounds. The states in each part are not.
+ *
+ * @param  data The compiled automaton.
+ * @param  n    Its length.
+ * @return      The header.
+ * @throws      BadFormat if the data is not a compiled automaton.
+ */
+FAFormat::Header FAFormat::readHeader(const char* data, const size_t& n) {
+
+  if (n < SYMBOLS_OFFSET) throw BadFormat();
+
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+
+  Header header;
+  const unsigned char* p = bytes;
+
+  for (uint32_t* field : {
+    &header.magic,
+    &header.version,
+    &header.kind,
+    &header.initial_state,
+    &header.state_count,
+    &header.final_count,
+    &header.symbol_count,
+    &header.class_count,
+    &header.transition_count,
+    &header.table_offset,
+    &header.accepting_offset,
+    &header.size
+  }) {
+
+    *field = read(p);
+    p += 4;
+  }
+
+  if (header.magic != MAGIC || header.version != VERSION ||
+      header.size != n || header.state_count == 0 ||
+      header.initial_state >= header.state_count ||
+      header.class_count == 0 || header.class_count > 256)
+
+    throw BadFormat();
+
+  for (size_t c = 0; c < 256; ++c)
+
+    if (bytes[CLASSES_OFFSET + c] >= header.class_count) throw BadFormat();
+
+  const uint64_t transitionsEnd = pad(SYMBOLS_OFFSET + header.symbol_count) +
+    4 * (static_cast<uint64_t>(header.final_count) + header.symbol_count) +
+    8 * static_cast<uint64_t>(header.transition_count);
+
+  uint64_t size = transitionsEnd;
+
+  if (header.kind == static_cast<uint32_t>(Kind::DFA)) {
+
+    const uint64_t rows = static_cast<uint64_t>(header.state_count) + 1;
+
+    if (header.table_offset != transitionsEnd ||
+        header.accepting_offset != transitionsEnd + 4 * rows * header.class_count)
+
+      throw BadFormat();
+
+    size = pad(header.accepting_offset + rows);
+  } else if (header.kind != static_cast<uint32_t>(Kind::NFA) ||
+             header.table_offset != 0 || header.accepting_offset != 0)
+
+    throw BadFormat();
+
+  if (size != n) throw BadFormat();
+
+  return header;
+}
+
+/**
+ * Writes the FA in the format of FAFormat. A DFA is written with its dense
+ * table, so that MappedDFA can use it.
+ *
+ * @param out Where to write it.
+ */
+void FA::save(std::ostream& out) const {
+
+  const DFA* dfa = dynamic_cast<const DFA*>(this);
+
+  size_t transitionCount = 0;
+
+  for (const std::vector<std::pair<state_type, state_type>>& pairs : transitions)
+
+    transitionCount += pairs.size();
+
+  std::string body(std::begin(byte_classes.classOf),
+                   std::end(byte_classes.classOf));
+
+  body.append(std::begin(symbols), std::end(symbols));
+  body.resize(pad(FAFormat::SYMBOLS_OFFSET + symbols.size()) -
+              FAFormat::CLASSES_OFFSET, '\0');
+
+  for (const state_type& f : final_states)
+
+    FAFormat::write(body, f);
+
+  for (const std::vector<std::pair<state_type, state_type>>& pairs : transitions)
+
+    FAFormat::write(body, pairs.size());
+
+  for (const std::vector<std::pair<state_type, state_type>>& pairs : transitions)
+
+    for (const std::pair<state_type, state_type>& pair : pairs) {
+
+      FAFormat::write(body, pair.first);
+      FAFormat::write(body, pair.second);
+    }
+
+  uint32_t tableOffset = 0, acceptingOffset = 0;
+
+  if (dfa) {
+
+    tableOffset = FAFormat::CLASSES_OFFSET + body.size();
+
+    for (const state_type& q : dfa->table)
+
+      FAFormat::write(body, q);
+
+    acceptingOffset = FAFormat::CLASSES_OFFSET + body.size();
+
+    body.append(std::begin(dfa->accepting), std::end(dfa->accepting));
+    body.resize(pad(body.size()), '\0');
+  }
+
+  const FAFormat::Kind kind = dfa ? FAFormat::Kind::DFA : FAFormat::Kind::NFA;
+
+  std::string header;
+
+  for (const uint32_t& field : {
+    FAFormat::MAGIC,
+    FAFormat::VERSION,
+    static_cast<uint32_t>(kind),
+    static_cast<uint32_t>(initial_state),
+    static_cast<uint32_t>(state_count),
+    static_cast<uint32_t>(final_states.size()),
+    static_cast<uint32_t>(symbols.size()),
+    static_cast<uint32_t>(byte_classes.count),
+    static_cast<uint32_t>(transitionCount),
+    tableOffset,
+    acceptingOffset,
+    static_cast<uint32_t>(FAFormat::CLASSES_OFFSET + body.size())
+  })
+
+    FAFormat::write(header, field);
+
+  out.write(header.data(), header.size());
+  out.write(body.data(), body.size());
+}
+
+/**
+ * Reads an FA written by FA::save.
+ *
+ * @param  data The compiled automaton.
+ * @param  n    Its length.
+ * @return      A DFA or an NFA, whichever was saved.
+ * @throws      BadFormat if the data is not a valid compiled automaton.
+ */
+std::unique_ptr<FA> FA::load(const char* data, const size_t& n) {
+
+  const FAFormat::Header header = FAFormat::readHeader(data, n);
+
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+
+  ByteClasses classes;
+
+  std::memcpy(classes.classOf.data(), bytes + FAFormat::CLASSES_OFFSET, 256);
+  classes.count = header.class_count;
+
+  const std::vector<symbol_type> symbols(
+    data + FAFormat::SYMBOLS_OFFSET,
+    data + FAFormat::SYMBOLS_OFFSET + header.symbol_count);
+
+  for (size_t i = 1; i < symbols.size(); ++i)
+
+    if (symbols[i - 1] >= symbols[i]) throw BadFormat();
+
+  const unsigned char* p =
+    bytes + pad(FAFormat::SYMBOLS_OFFSET + header.symbol_count);
+
+  /* Reads the next state. */
+  auto state = [&]() {
+
+    const state_type q = FAFormat::read(p);
+
+    p += 4;
+
+    if (q >= header.state_count) throw BadFormat();
+
+    return q;
+  };
+
+  std::vector<state_type> final_states;
+
+  for (size_t i = 0; i < header.final_count; ++i) {
+
+    final_states.push_back(state());
+
+    if (i > 0 && final_states[i - 1] >= final_states[i]) throw BadFormat();
+  }
+
+  std::vector<size_t> counts;
+  size_t total = 0;
+
+  for (size_t i = 0; i < header.symbol_count; ++i) {
+
+    counts.push_back(FAFormat::read(p));
+    total += counts.back();
+    p += 4;
+  }
+
+  if (total != header.transition_count) throw BadFormat();
+
+  std::vector<std::vector<std::pair<state_type, state_type>>> transitions;
+
+  for (const size_t& count : counts) {
+
+    transitions.emplace_back();
+
+    for (size_t i = 0; i < count; ++i) {
+
+      const state_type from = state();
+      const state_type to   = state();
+
+      transitions.back().emplace_back(from, to);
+    }
+
+    if (!std::is_sorted(std::begin(transitions.back()),
+                        std::end(transitions.back())))
+
+      throw BadFormat();
+  }
+
+  if (header.kind == static_cast<uint32_t>(FAFormat::Kind::DFA))
+
+    return std::unique_ptr<FA>(new DFA(header.initial_state, final_states,
+                                       symbols, transitions, classes));
+
+  return std::unique_ptr<FA>(new NFA(header.initial_state, final_states,
+                                     symbols, transitions, classes));
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "FA.h"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * The binary format written by FA::save, and read by FA::load and MappedDFA.
+ *
+ * Every number is a little-endian uint32_t whatever the host, and every part
+ * starts at a multiple of 4 bytes, so the file can be used where it lies:
+ *
+ *   header        The numbers in Header, in order.
+ *   classes       256 bytes: the byte class of each byte.
+ *   symbols       symbol_count bytes, padded to a multiple of 4.
+ *   final_states  final_count numbers.
+ *   counts        symbol_count numbers: how many transitions each symbol has.
+ *   transitions   transition_count pairs of numbers, (from, to), by symbol.
+ *   table         For a DFA, (state_count + 1) * class_count numbers: DFA's
+ *                 dense table, whose last row is the dead state.
+ *   accepting     For a DFA, state_count + 1 bytes.
+ *
+ * VERSION goes up whenever the layout changes, and files of other versions
+ * are rejected.
+ */
+class FAFormat {
+
+public:
+
+  enum class Kind : uint32_t {
+
+    DFA = 0,
+    NFA = 1
+  };
+
+  struct Header {
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t kind;
+    uint32_t initial_state;
+    uint32_t state_count;
+    uint32_t final_count;
+    uint32_t symbol_count;
+    uint32_t class_count;
+    uint32_t transition_count;
+    uint32_t table_offset;      // 0 for an NFA.
+    uint32_t accepting_offset;  // 0 for an NFA.
+    uint32_t size;              // Of the whole file.
+  };
+
+  static const uint32_t MAGIC   = 0x74754146; // "FAut"
+  static const uint32_t VERSION = 1;
+
+  static const size_t CLASSES_OFFSET = sizeof(Header);
+  static const size_t SYMBOLS_OFFSET = CLASSES_OFFSET + 256;
+
+  static uint32_t read(const unsigned char*);
+  static void     write(std::string&, const uint32_t&);
+
+  static Header readHeader(const char*, const size_t&);
+};
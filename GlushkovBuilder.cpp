@@ -0,0 +1,107 @@
+#include "GlushkovBuilder.h"
+
+#include <iterator>
+
+/* Appends the elements of b to a. Positions from different parts of the
+ * regex are distinct, so this is a union.
+ */
+static std::vector<FA::state_type> join( const std::vector<FA::state_type>& a,
+                                         const std::vector<FA::state_type>& b) {
+
+  std::vector<FA::state_type> joined(a);
+
+  joined.insert(std::end(joined), std::begin(b), std::end(b));
+
+  return joined;
+}
+
+/* State 0 is the initial state, which is not a position. */
+GlushkovBuilder::GlushkovBuilder() :
+  symbols_of(1) {
+
+  faBuilder.initial_state(0);
+}
+
+GlushkovBuilder::Fragment GlushkovBuilder::empty() {
+
+  return {{}, {}, true};
+}
+
+GlushkovBuilder::Fragment GlushkovBuilder::symbols(
+  const FA::symbol_set_type& set) {
+
+  const FA::state_type p = symbols_of.size();
+
+  symbols_of.push_back(set);
+
+  return {{p}, {p}, false};
+}
+
+GlushkovBuilder::Fragment GlushkovBuilder::concatenate(const Fragment& frag1,
+                                                       const Fragment& frag2) {
+
+  follow(frag1.last, frag2.first);
+
+  return {frag1.nullable ? join(frag1.first, frag2.first) : frag1.first,
+          frag2.nullable ? join(frag1.last,  frag2.last)  : frag2.last,
+          frag1.nullable && frag2.nullable};
+}
+
+GlushkovBuilder::Fragment GlushkovBuilder::alternate(const Fragment& frag1,
+                                                     const Fragment& frag2) {
+
+  return {join(frag1.first, frag2.first),
+          join(frag1.last,  frag2.last),
+          frag1.nullable || frag2.nullable};
+}
+
+GlushkovBuilder::Fragment GlushkovBuilder::repeat(const Fragment& frag) {
+
+  follow(frag.last, frag.first);
+
+  return {frag.first, frag.last, true};
+}
+
+GlushkovBuilder::Fragment GlushkovBuilder::plus(const Fragment& frag) {
+
+  follow(frag.last, frag.first);
+
+  return frag;
+}
+
+GlushkovBuilder::Fragment GlushkovBuilder::optional(const Fragment& frag) {
+
+  return {frag.first, frag.last, true};
+}
+
+/**
+ * Builds an FA which accepts what frag matches.
+ *
+ * @param  frag The fragment for the whole regex.
+ * @return      The FA.
+ */
+std::unique_ptr<FA> GlushkovBuilder::build(const Fragment& frag) {
+
+  follow({0}, frag.first);
+
+  for (const FA::state_type& p : frag.last)
+
+    faBuilder.final_state(p);
+
+  if (frag.nullable)
+
+    faBuilder.final_state(0);
+
+  return faBuilder.build();
+}
+
+/* Adds a transition from every position in from to every position in to. */
+void GlushkovBuilder::follow(const std::vector<FA::state_type>& from,
+                             const std::vector<FA::state_type>& to) {
+
+  for (const FA::state_type& p : from)
+
+    for (const FA::state_type& q : to)
+
+      faBuilder.transition(p, symbols_of[q], q);
+}
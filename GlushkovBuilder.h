@@ -0,0 +1,56 @@
+#pragma once
+
+#include "FA.h"
+#include "FABuilder.h"
+
+#include <vector>
+#include <memory>
+
+/**
+ * Builds an FA from a regex one piece at a time, by Glushkov's construction.
+ *
+ * Every occurrence of a symbol (or set of symbols) in the regex is a
+ * position, and becomes a state which is only ever entered on those symbols;
+ * state 0 is the initial state. A Fragment records which of its positions
+ * can come first and last in a match, and whether it matches the empty
+ * string. Combining fragments adds the transitions from last positions to
+ * first positions (followpos) as soon as they are known.
+ *
+ * The result has no EPSILON transitions, at most one state per symbol of
+ * the regex plus one, and is often deterministic already. It has the same
+ * interface as ThompsonBuilder, so the parser can drive either.
+ */
+class GlushkovBuilder {
+
+public:
+
+  struct Fragment {
+
+    std::vector<FA::state_type> first;
+    std::vector<FA::state_type> last;
+    bool nullable;
+  };
+
+  GlushkovBuilder();
+
+  Fragment empty();
+  Fragment symbols(const FA::symbol_set_type&);
+
+  Fragment concatenate(const Fragment&, const Fragment&);
+  Fragment alternate  (const Fragment&, const Fragment&);
+  Fragment repeat     (const Fragment&);
+  Fragment plus       (const Fragment&);
+  Fragment optional   (const Fragment&);
+
+  std::unique_ptr<FA> build(const Fragment&);
+
+private:
+
+  void follow(const std::vector<FA::state_type>&,
+              const std::vector<FA::state_type>&);
+
+  FABuilder faBuilder;
+
+  /* The symbols which lead into each position. */
+  std::vector<FA::symbol_set_type> symbols_of;
+};
@@ -0,0 +1,316 @@
+#include "LazyDFA.h"
+
+#include "SparseSet.h"
+#include "Scratch.h"
+
+#include <vector>
+#include <algorithm>
+#include <iterator>
+
+const FA::state_type LazyDFA::UNKNOWN;
+const FA::state_type LazyDFA::DEAD;
+
+LazyDFA::Cache::Cache(const size_t& rows, const size_t& classes) :
+  table(new std::atomic<state_type>[rows * classes]),
+  accepting(new char[rows]),
+  usedBytes(0),
+  start(0) {}
+
+LazyDFA::LazyDFA(const FA& fa, const size_t& cacheBytes) :
+  FA(fa),
+  nfa(initial_state, final_states, symbols, transitions, byte_classes),
+  cacheBytes(cacheBytes),
+  maxStates(cacheBytes / (byte_classes.count * sizeof(state_type)) + 3),
+  scannedSinceFlush(0),
+  successors(state_count) {
+
+  flush();
+}
+
+/* Each LazyDFA builds a cache of its own. */
+LazyDFA::LazyDFA(const LazyDFA& other) :
+  FA(other),
+  nfa(other.nfa),
+  cacheBytes(other.cacheBytes),
+  maxStates(other.maxStates),
+  scannedSinceFlush(0),
+  successors(state_count) {
+
+  flush();
+}
+
+bool LazyDFA::match(const char* arr, const size_t& n) const {
+
+  return scan(arr, arr + n) == MatchStatus::MATCH;
+}
+
+bool LazyDFA::match(std::string::const_iterator first,
+                    std::string::const_iterator last) const {
+
+  const char* arr = first == last ? nullptr : &*first;
+
+  return scan(arr, arr + (last - first)) == MatchStatus::MATCH;
+}
+
+MatchStatus LazyDFA::matchStatus(const char* arr, const size_t& n) const {
+
+  return scan(arr, arr + n);
+}
+
+/* Finding where a match starts needs the NFA's per-thread start positions,
+ * which a DFA state cannot record, so searching is left to the NFA.
+ */
+std::pair<const char*, const size_t> LazyDFA::findNext( const char* arr,
+                                                        const size_t& n) const {
+
+  return nfa.findNext(arr, n);
+}
+
+std::pair<std::string::const_iterator, std::string::const_iterator>
+  LazyDFA::findNext(std::string::const_iterator first,
+                    std::string::const_iterator last) const {
+
+  return nfa.findNext(first, last);
+}
+
+std::pair<const char*, const char*> LazyDFA::find(
+  const char* first, const char* last,
+  const MatchSemantics& semantics) const {
+
+  return nfa.find(first, last, semantics);
+}
+
+std::pair<std::string::const_iterator, std::string::const_iterator>
+  LazyDFA::find(std::string::const_iterator first,
+                std::string::const_iterator last,
+                const MatchSemantics& semantics) const {
+
+  return nfa.find(first, last, semantics);
+}
+
+void LazyDFA::startStates(std::vector<state_type>& out) const {
+
+  nfa.startStates(out);
+}
+
+void LazyDFA::step( const state_type& q, const symbol_type& a,
+                    std::vector<state_type>& out) const {
+
+  nfa.step(q, a, out);
+}
+
+std::unique_ptr<FA> LazyDFA::normalize(ThreadPool& pool) const {
+
+  return nfa.normalize(pool);
+}
+
+/**
+ * Runs the lazy DFA over [first, last).
+ *
+ * The cache is only locked to fill in a transition which is missing from it.
+ * If another scan has flushed it meanwhile, this one carries on in the new
+ * cache from there.
+ *
+ * @param  first The beginning of the input.
+ * @param  last  The end of the input.
+ * @return       Whether the input was accepted, and if not, why not.
+ */
+MatchStatus LazyDFA::scan(const char* first, const char* last) const {
+
+  std::shared_ptr<const Cache> snapshot = std::atomic_load(&cache);
+
+  state_type currState = snapshot->start;
+  size_t scanned = 0;
+
+  for (; first != last; ++first, ++scanned) {
+
+    const size_t c = byte_classes.classOf[static_cast<unsigned char>(*first)];
+
+    state_type nextState = snapshot->table[currState * byte_classes.count + c]
+                             .load(std::memory_order_acquire);
+
+    if (nextState == UNKNOWN) {
+
+      std::unique_lock<std::mutex> lock(mutex);
+
+      scannedSinceFlush += scanned;
+      scanned = 0;
+
+      /* The snapshot keeps the set alive even if its cache is flushed. */
+      const std::vector<state_type>& currSet = *snapshot->sets[currState];
+
+      nextState = computeTransition(currSet, c);
+
+      /* If the cache had to be flushed and it was thrashing, finish with the
+       * Pike VM, starting from the NFA states we have reached so far.
+       */
+      if (nextState == UNKNOWN) {
+
+        SparseSet& states = Scratch::set(Scratch::NFA_CURRENT, state_count);
+
+        for (const state_type& q : currSet)
+
+          states.insert(q);
+
+        lock.unlock();
+
+        return nfa.simulate(states, first, last);
+      }
+
+      snapshot = cache;
+    }
+
+    if (nextState == DEAD) {
+
+      scannedSinceFlush += scanned;
+
+      return MatchStatus::DEAD_STATE;
+    }
+
+    currState = nextState;
+  }
+
+  scannedSinceFlush += scanned;
+
+  return snapshot->accepting[currState] ? MatchStatus::MATCH
+                                        : MatchStatus::NO_MATCH;
+}
+
+/**
+ * Computes the transition from a set of NFA states on byte class c, and
+ * caches it in the current cache, adding the set too if it is not there.
+ * Called under the mutex.
+ *
+ * If the states do not fit in the cache, it is flushed first. If it was
+ * thrashing, nothing is added and UNKNOWN is returned, so that the caller
+ * can stop using the lazy DFA.
+ *
+ * @param  from The set to move from, which may be in a cache that has been
+ *              flushed since.
+ * @param  c    The byte class to move on.
+ * @return      The next state in the current cache, DEAD or UNKNOWN.
+ */
+FA::state_type LazyDFA::computeTransition(const std::vector<state_type>& from,
+                                          const size_t& c) const {
+
+  successors.clear();
+
+  nfa.delta(from, c, successors);
+
+  auto known = cache->ids.find(from);
+
+  state_type q = known == std::end(cache->ids) ? UNKNOWN : known->second;
+
+  if (successors.empty()) {
+
+    if (q != UNKNOWN)
+
+      cache->table[q * byte_classes.count + c].store(DEAD,
+                                                     std::memory_order_release);
+
+    return DEAD;
+  }
+
+  successorSet.assign(std::begin(successors), std::end(successors));
+
+  std::sort(std::begin(successorSet), std::end(successorSet));
+
+  known = cache->ids.find(successorSet);
+
+  state_type next = known == std::end(cache->ids) ? UNKNOWN : known->second;
+
+  const size_t newStates = (q == UNKNOWN) + (next == UNKNOWN);
+  const size_t newSizes  = (q == UNKNOWN ? from.size() : 0) +
+                           (next == UNKNOWN ? successorSet.size() : 0);
+
+  if (!fits(newStates, newSizes)) {
+
+    const bool thrashing =
+      scannedSinceFlush < MIN_BYTES_PER_STATE * cache->sets.size();
+
+    flush();
+
+    if (thrashing)
+
+      return UNKNOWN;
+
+    q = next = UNKNOWN;
+  }
+
+  if (q == UNKNOWN)
+
+    q = addState(*cache, from);
+
+  if (next == UNKNOWN)
+
+    next = addState(*cache, successorSet);
+
+  cache->table[q * byte_classes.count + c].store(next,
+                                                 std::memory_order_release);
+
+  return next;
+}
+
+/**
+ * @param  states   The number of states to add.
+ * @param  nfaSizes The number of NFA states in their sets, between them.
+ * @return          Whether the current cache has room for them.
+ */
+bool LazyDFA::fits(const size_t& states, const size_t& nfaSizes) const {
+
+  const size_t bytes = states * byte_classes.count * sizeof(state_type) +
+                       2 * nfaSizes * sizeof(state_type);
+
+  return cache->usedBytes + bytes <= cacheBytes &&
+         cache->sets.size() + states <= maxStates;
+}
+
+/* Adds a state for a sorted, EPSILON-closed set of NFA states, unless there
+ * is one already. Its row is filled in before anything can refer to it.
+ */
+FA::state_type LazyDFA::addState(Cache& to,
+                                 const std::vector<state_type>& states) const {
+
+  const state_type id = to.sets.size();
+
+  auto inserted = to.ids.emplace(states, id);
+
+  if (!inserted.second)
+
+    return inserted.first->second;
+
+  to.sets.push_back(&inserted.first->first);
+
+  for (size_t c = 0; c < byte_classes.count; ++c)
+
+    to.table[id * byte_classes.count + c].store(UNKNOWN,
+                                                std::memory_order_relaxed);
+
+  to.accepting[id] = std::any_of(std::begin(states), std::end(states),
+                                 [this] (const state_type& q) -> bool {
+
+                                   return nfa.accepting[q];
+                                 });
+
+  to.usedBytes += byte_classes.count * sizeof(state_type) +
+                  2 * states.size() * sizeof(state_type);
+
+  return id;
+}
+
+/* Replaces the cache with one holding only the start state. */
+void LazyDFA::flush() const {
+
+  std::shared_ptr<Cache> fresh =
+    std::make_shared<Cache>(maxStates, byte_classes.count);
+
+  std::vector<state_type> startSet = nfa.epsilon_closure(initial_state);
+
+  std::sort(std::begin(startSet), std::end(startSet));
+
+  fresh->start = addState(*fresh, startSet);
+
+  std::atomic_store(&cache, fresh);
+
+  scannedSinceFlush = 0;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "FA.h"
+#include "NFA.h"
+#include "SparseSet.h"
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * A DFA which is determinized on demand, while it is matching.
+ *
+ * Each DFA state is a set of states of the underlying NFA, and is only built
+ * the first time the input reaches it; transitions are cached in a dense
+ * table just like DFA's. The cache is limited to a fixed number of bytes.
+ * When it fills up it is flushed and rebuilt from the current state, and if
+ * that happens so often that little input is consumed per state built, the
+ * rest of the input is given to the NFA's Pike VM instead.
+ *
+ * This gives DFA speed on the states that real input visits without paying
+ * for the (possibly exponentially many) states it never reaches.
+ *
+ * Matches on one LazyDFA can run at once. They read the cache without
+ * locking and only take a lock to add to it, so once the states that real
+ * input visits have been built, threads do not wait for each other.
+ */
+class LazyDFA :
+  public FA {
+
+public:
+
+  LazyDFA() = delete;
+
+  LazyDFA(const LazyDFA&);
+
+  virtual bool match (const char*, const size_t&) const;
+
+  virtual bool match( std::string::const_iterator,
+                      std::string::const_iterator) const;
+
+  virtual MatchStatus matchStatus(const char*, const size_t&) const;
+
+  virtual std::pair<const char*, const size_t> findNext(const char*,
+                                                        const size_t&) const;
+
+  virtual std::pair<std::string::const_iterator, std::string::const_iterator>
+    findNext(std::string::const_iterator, std::string::const_iterator) const;
+
+  friend class FA;
+
+private:
+
+  LazyDFA(const FA&, const size_t& cacheBytes);
+
+  virtual void startStates(std::vector<state_type>&) const;
+  virtual void step(const state_type&, const symbol_type&,
+                    std::vector<state_type>&) const;
+
+  virtual std::pair<const char*, const char*>
+    find(const char*, const char*, const MatchSemantics&) const;
+  virtual std::pair<std::string::const_iterator, std::string::const_iterator>
+    find( std::string::const_iterator, std::string::const_iterator,
+          const MatchSemantics&) const;
+
+  virtual std::unique_ptr<FA> normalize(ThreadPool&) const;
+
+  /* One generation of the cache, replaced as a whole when it is flushed.
+   *
+   * Each state's row of the table holds UNKNOWN for transitions which have
+   * not been computed yet, and DEAD for those which lead to the empty set.
+   * Its row and whether it is accepting are filled in before its number is
+   * stored in the table, so a scan which reads that number can read them
+   * without locking. A flushed cache stays alive until the last scan reading
+   * it lets go. Everything else is only touched under the mutex.
+   */
+  struct Cache {
+
+    Cache(const size_t& rows, const size_t& classes);
+
+    std::unordered_map<std::vector<state_type>, state_type,
+                       StateSetHash> ids;
+    std::vector<const std::vector<state_type>*> sets;
+    std::unique_ptr<std::atomic<state_type>[]> table;
+    std::unique_ptr<char[]> accepting;
+    size_t usedBytes;
+    state_type start;
+  };
+
+  MatchStatus scan(const char*, const char*) const;
+
+  state_type addState(Cache&, const std::vector<state_type>&) const;
+  state_type computeTransition(const std::vector<state_type>&,
+                               const size_t&) const;
+  bool       fits(const size_t&, const size_t&) const;
+  void       flush() const;
+
+  static const state_type UNKNOWN = static_cast<state_type>(-1);
+  static const state_type DEAD    = static_cast<state_type>(-2);
+
+  /* A cache is thrashing if fewer than this many bytes were scanned per
+   * state built since it was last flushed.
+   */
+  static const size_t MIN_BYTES_PER_STATE = 10;
+
+  const NFA nfa;
+  const size_t cacheBytes;
+
+  /* The most states a cache can hold: as many rows as fit in cacheBytes, and
+   * room for the few states a fresh cache is given whatever their size.
+   */
+  const size_t maxStates;
+
+  /* The current cache, which scans load atomically. */
+  mutable std::shared_ptr<Cache> cache;
+
+  mutable std::atomic<size_t> scannedSinceFlush;
+
+  /* Scratch space for computeTransition. */
+  mutable SparseSet successors;
+  mutable std::vector<state_type> successorSet;
+
+  /* Held while the cache is added to or flushed. */
+  mutable std::mutex mutex;
+};
@@ -0,0 +1,121 @@
+#include "MappedDFA.h"
+
+#include "FAFormat.h"
+#include "FAExcept.h"
+
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Maps a compiled DFA into memory.
+ *
+ * @param  path The file, as written by FA::save for a DFA.
+ * @throws      std::system_error if the file cannot be mapped, and BadFormat
+ *              if it does not hold a DFA.
+ */
+MappedDFA::MappedDFA(const std::string& path) {
+
+  const int fd = open(path.c_str(), O_RDONLY);
+
+  if (fd < 0)
+
+    throw std::system_error(errno, std::generic_category(), path);
+
+  struct stat st;
+
+  if (fstat(fd, &st) < 0) {
+
+    const int error = errno;
+
+    close(fd);
+    throw std::system_error(error, std::generic_category(), path);
+  }
+
+  size = st.st_size;
+  mapping = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : nullptr;
+
+  const int error = errno;
+
+  close(fd);
+
+  if (mapping == MAP_FAILED)
+
+    throw std::system_error(error, std::generic_category(), path);
+
+  const char* data = static_cast<const char*>(mapping);
+  const unsigned char* bytes = static_cast<const unsigned char*>(mapping);
+
+  try {
+
+    const FAFormat::Header header = FAFormat::readHeader(data, size);
+
+    if (header.kind != static_cast<uint32_t>(FAFormat::Kind::DFA))
+
+      throw BadFormat();
+
+    initial_state = header.initial_state;
+    dead_state    = header.state_count;
+    class_count   = header.class_count;
+
+    classOf   = bytes + FAFormat::CLASSES_OFFSET;
+    table     = bytes + header.table_offset;
+    accepting = bytes + header.accepting_offset;
+  } catch (...) {
+
+    if (mapping) munmap(mapping, size);
+    throw;
+  }
+}
+
+MappedDFA::~MappedDFA() {
+
+  munmap(mapping, size);
+}
+
+bool MappedDFA::match(const char* arr, const size_t& n) const {
+
+  return matchStatus(arr, n) == MatchStatus::MATCH;
+}
+
+bool MappedDFA::match(std::string::const_iterator first,
+                      std::string::const_iterator last) const {
+
+  return status(delta(first, last)) == MatchStatus::MATCH;
+}
+
+MatchStatus MappedDFA::matchStatus(const char* arr, const size_t& n) const {
+
+  return status(delta(arr, arr + n));
+}
+
+/* The table is never checked as a whole, since that would read all of it.
+ * Instead, any state past the dead state is treated as the dead state.
+ */
+template <typename InputIterator>
+FA::state_type MappedDFA::delta(InputIterator first, InputIterator last) const {
+
+  FA::state_type q = initial_state;
+
+  for (; first != last && q < dead_state; ++first) {
+
+    const size_t c = classOf[static_cast<unsigned char>(*first)];
+
+    q = FAFormat::read(table + 4 * (q * class_count + c));
+  }
+
+  return q;
+}
+
+MatchStatus MappedDFA::status(const FA::state_type& q) const {
+
+  if (q >= dead_state)
+
+    return MatchStatus::DEAD_STATE;
+
+  return accepting[q] ? MatchStatus::MATCH : MatchStatus::NO_MATCH;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "FA.h"
+
+#include <string>
+
+/**
+ * A DFA which is run straight from a file written by FA::save.
+ *
+ * The file is mapped into memory and its dense table used where it lies, so
+ * opening it takes no time or memory per state, and every process which maps
+ * the same file shares one copy of it in the page cache. Only the table is
+ * used, so this can match, but not search or be combined with other FAs; use
+ * FA::load for that.
+ */
+class MappedDFA {
+
+public:
+
+  MappedDFA() = delete;
+
+  explicit MappedDFA(const std::string& path);
+
+  MappedDFA(const MappedDFA&) = delete;
+  MappedDFA& operator = (const MappedDFA&) = delete;
+
+  ~MappedDFA();
+
+  bool match (const char*, const size_t&) const;
+
+  bool match( std::string::const_iterator,
+              std::string::const_iterator) const;
+
+  MatchStatus matchStatus(const char*, const size_t&) const;
+
+private:
+
+  template <typename InputIterator>
+  FA::state_type delta(InputIterator, InputIterator) const;
+
+  MatchStatus status(const FA::state_type&) const;
+
+  void*  mapping;
+  size_t size;
+
+  FA::state_type initial_state;
+  FA::state_type dead_state;
+  size_t         class_count;
+
+  /* Into the mapping. */
+  const unsigned char* classOf;
+  const unsigned char* table;
+  const unsigned char* accepting;
+};
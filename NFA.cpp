@@ -1,212 +1,659 @@
 #include "NFA.h"
 
-#include "FABuilder.h"
-#include "FAExcept.h"
+#include "DFA.h"
+#include "SparseSet.h"
+#include "Scratch.h"
+#include "ThreadPool.h"
 
-#include <set>
-#include <map>
 #include <vector>
+#include <unordered_map>
 #include <algorithm>
 #include <iterator>
 
-bool NFA::match(const char* arr, const size_t& n) const {
+NFA::NFA(const state_type& initial_state,
+         const std::vector<state_type>& final_states,
+         const std::vector<symbol_type>& symbols,
+         const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions,
+         const ByteClasses& byte_classes) :
+  FA(initial_state, final_states, symbols, transitions, byte_classes),
+  step_offsets(state_count * byte_classes.count + 1, 0),
+  eps_offsets(state_count + 1, 0),
+  accepting(state_count, false) {
+
+  /* Every symbol in a class has the same transitions, so only the first one
+   * seen for each class is needed.
+   */
+  std::vector<const std::vector<std::pair<state_type, state_type>>*>
+    classTransitions(byte_classes.count, nullptr);
+  const std::vector<std::pair<state_type, state_type>>* epsTransitions = nullptr;
+
+  for (size_t i = 0; i < symbols.size(); ++i) {
+
+    if (symbols[i] == EPSILON) {
+
+      epsTransitions = &transitions[i];
+      continue;
+    }
+
+    const unsigned char c =
+      byte_classes.classOf[static_cast<unsigned char>(symbols[i])];
+
+    if (classTransitions[c] == nullptr)
+
+      classTransitions[c] = &transitions[i];
+  }
+
+  /* Count the successors of each (state, class) pair, turn the counts into
+   * offsets, then fill in the targets.
+   */
+  for (size_t c = 0; c < byte_classes.count; ++c)
+
+    if (classTransitions[c] != nullptr)
+
+      for (const std::pair<state_type, state_type>& pair : *classTransitions[c])
+
+        ++step_offsets[pair.first * byte_classes.count + c + 1];
+
+  for (size_t i = 1; i < step_offsets.size(); ++i)
+
+    step_offsets[i] += step_offsets[i - 1];
+
+  step_targets.resize(step_offsets.back());
+
+  std::vector<size_t> fill(std::begin(step_offsets), std::end(step_offsets) - 1);
+
+  for (size_t c = 0; c < byte_classes.count; ++c)
+
+    if (classTransitions[c] != nullptr)
+
+      for (const std::pair<state_type, state_type>& pair : *classTransitions[c])
+
+        step_targets[fill[pair.first * byte_classes.count + c]++] = pair.second;
+
+  if (epsTransitions != nullptr) {
+
+    for (const std::pair<state_type, state_type>& pair : *epsTransitions)
+
+      ++eps_offsets[pair.first + 1];
+
+    for (size_t i = 1; i < eps_offsets.size(); ++i)
+
+      eps_offsets[i] += eps_offsets[i - 1];
 
-  std::set<state_type> end_states = delta({initial_state}, arr, arr + n);
+    /* The pairs are sorted by start state, so they are already in order. */
+    for (const std::pair<state_type, state_type>& pair : *epsTransitions)
 
-  return std::find_first_of(std::begin(end_states), std::end(end_states),
-                            std::begin(final_states), std::end(final_states)) !=
-    std::end(end_states);
+      eps_targets.push_back(pair.second);
+  }
+
+  /* Precompute the EPSILON closure of every state, each one stored as a row
+   * of closure_states which begins with the state itself.
+   */
+  SparseSet closure(state_count);
+
+  closure_offsets.reserve(state_count + 1);
+  closure_offsets.push_back(0);
+
+  for (state_type q = 0; q < state_count; ++q) {
+
+    closure.clear();
+    closure.insert(q);
+
+    for (size_t next = 0; next < closure.size(); ++next) {
+
+      const state_type p = closure[next];
+
+      for (size_t i = eps_offsets[p]; i < eps_offsets[p + 1]; ++i)
+
+        closure.insert(eps_targets[i]);
+    }
+
+    closure_states.insert(std::end(closure_states),
+                          std::begin(closure), std::end(closure));
+    closure_offsets.push_back(closure_states.size());
+  }
+
+  for (const state_type& f : final_states)
+
+    accepting[f] = true;
+}
+
+bool NFA::match(const char* arr, const size_t& n) const {
+
+  return simulate(arr, arr + n) == MatchStatus::MATCH;
 }
 
 bool NFA::match(std::string::const_iterator first,
                 std::string::const_iterator last) const {
 
-  std::set<state_type> end_states = delta({initial_state}, first, last);
+  return simulate(first, last) == MatchStatus::MATCH;
+}
+
+MatchStatus NFA::matchStatus(const char* arr, const size_t& n) const {
 
-  return std::find_first_of(std::begin(end_states), std::end(end_states),
-                            std::begin(final_states), std::end(final_states)) !=
-    std::end(end_states);
+  return simulate(arr, arr + n);
 }
 
 std::pair<const char*, const size_t> NFA::findNext( const char* arr,
                                                     const size_t& n) const {
 
-  if (n == 0) return {arr + n, 0};
+  const std::pair<const char*, const char*> found =
+    search(arr, arr + n, MatchSemantics::LEFTMOST_LONGEST);
 
-  std::set<state_type> currState = {initial_state};
-  size_t endPos = 0;
+  return {found.first, found.second - found.first};
+}
 
-  try {
+std::pair<std::string::const_iterator, std::string::const_iterator>
+  NFA::findNext(std::string::const_iterator first,
+                std::string::const_iterator last) const {
 
-    while ( std::find_first_of( std::begin(final_states), std::end(final_states),
-                                std::begin(currState),    std::end(currState)) !=
-            std::end(final_states))
+  return search(first, last, MatchSemantics::LEFTMOST_LONGEST);
+}
 
-      currState = delta(currState, arr[endPos++]);
+std::pair<const char*, const char*> NFA::find(
+  const char* first, const char* last,
+  const MatchSemantics& semantics) const {
 
-    return {arr, endPos};
-  } catch (const NoTransitionException& e) {
+  return search(first, last, semantics);
+}
 
-    return findNext(arr + 1, n - 1);
-  }
+std::pair<std::string::const_iterator, std::string::const_iterator>
+  NFA::find(std::string::const_iterator first,
+            std::string::const_iterator last,
+            const MatchSemantics& semantics) const {
 
-  // Unnecessary, but I guess the compiler doesn't know that.
-  return {arr + n, 0};
+  return search(first, last, semantics);
 }
 
-std::pair<std::string::const_iterator, std::string::const_iterator>
-  NFA::findNext(std::string::const_iterator first,
-                std::string::const_iterator last) const {
+template <typename InputIterator>
+MatchStatus NFA::simulate(InputIterator first, InputIterator last) const {
 
-  if (first == last) return {last, last};
+  SparseSet& currStates = Scratch::set(Scratch::NFA_CURRENT, state_count);
 
-  std::set<state_type> currState = {initial_state};
-  std::string::const_iterator currIt = first;
+  addClosure(currStates, initial_state);
 
-  try {
+  return simulate(currStates, first, last);
+}
+
+/**
+ * Runs the NFA over [first, last) as a Pike VM.
+ *
+ * The current and next sets of states are sparse sets kept for each thread
+ * (see Scratch), so no memory is allocated per input byte, and each state is
+ * visited at most once per byte however many paths lead to it.
+ *
+ * @param  currStates The EPSILON-closed set of states to start from. It holds
+ *                    the states reached at the end of the input afterwards.
+ * @param  first      The beginning of the input.
+ * @param  last       The end of the input.
+ * @return            Whether the input was accepted, and if not, why not.
+ */
+template <typename InputIterator>
+MatchStatus NFA::simulate(SparseSet& currStates,
+                          InputIterator first, InputIterator last) const {
 
-    while ( std::find_first_of( std::begin(final_states), std::end(final_states),
-                                std::begin(currState),    std::end(currState)) !=
-            std::end(final_states))
+  SparseSet& nextStates = Scratch::set(Scratch::NFA_NEXT, state_count);
 
-      currState = delta(currState, *currIt++);
+  for (; first != last; ++first) {
 
-    return {first, currIt};
-  } catch (const NoTransitionException& e) {
+    const size_t c = byte_classes.classOf[static_cast<unsigned char>(*first)];
 
-    return findNext(++first, last);
+    nextStates.clear();
+
+    for (const state_type& q : currStates) {
+
+      const size_t row = q * byte_classes.count + c;
+
+      for (size_t i = step_offsets[row]; i < step_offsets[row + 1]; ++i)
+
+        addClosure(nextStates, step_targets[i]);
+    }
+
+    std::swap(currStates, nextStates);
+
+    if (currStates.empty())
+
+      return MatchStatus::DEAD_STATE;
   }
 
-  // Unnecessary, but I guess the compiler doesn't know that.
-  return {last, last};
-}
+  for (const state_type& q : currStates)
 
-std::unique_ptr<FA> NFA::normalize() const {
+    if (accepting[q])
 
-  return FA::normalize(makeDeterministic());
+      return MatchStatus::MATCH;
+
+  return MatchStatus::NO_MATCH;
 }
 
-std::string state_from_set(const std::set<FA::state_type>& states) {
+/* LazyDFA hands over to the Pike VM part way through its input. */
+template MatchStatus NFA::simulate(SparseSet&, const char*, const char*) const;
+
+/**
+ * Finds the leftmost substring of [first, last) which the NFA accepts.
+ *
+ * This is the Pike VM from simulate(), run as if the NFA were prefixed by .*:
+ * a new thread starts at every position, tagged with that position. Threads
+ * are kept in order of their start positions and only the earliest thread in
+ * each state survives, so the whole search is a single pass. Once a thread
+ * accepts, threads which started after it are dropped, and the search ends as
+ * soon as no earlier (or, for the longest match, equally early) thread is
+ * left. Empty matches are only reported before the end of the input.
+ *
+ * @param  first     The beginning of the input.
+ * @param  last      The end of the input.
+ * @param  semantics Whether to stop at the first final state or the last.
+ * @return           The bounds of the match, or {last, last} if there is none.
+ */
+template <typename InputIterator>
+std::pair<InputIterator, InputIterator> NFA::search(
+  InputIterator first, InputIterator last,
+  const MatchSemantics& semantics) const {
 
-  std::string newState;
+  const bool longest = semantics == MatchSemantics::LEFTMOST_LONGEST;
 
-  for (const FA::state_type& state : states)
+  SparseSet& currStates = Scratch::set(Scratch::NFA_CURRENT, state_count);
+  SparseSet& nextStates = Scratch::set(Scratch::NFA_NEXT, state_count);
+  std::vector<InputIterator>& currStarts =
+    Scratch::vector<InputIterator>(Scratch::NFA_CURRENT, state_count);
+  std::vector<InputIterator>& nextStarts =
+    Scratch::vector<InputIterator>(Scratch::NFA_NEXT, state_count);
 
-    newState += std::to_string(state);
+  bool found = false;
+  std::pair<InputIterator, InputIterator> match {last, last};
 
-  return newState;
-}
+  const Prefilter& filter = searchPrefilter();
+
+  InputIterator candidate = nextLiteral(first, last);
+
+  for (InputIterator currIt = first; ; ++currIt) {
+
+    /* With no threads left, a match has to contain the next occurrence of
+     * the required literal, so there is nothing to do without one. If every
+     * match starts with it, skip straight there; otherwise skip to where one
+     * of the possible prefixes might start.
+     */
+    if (!found && currStates.empty()) {
+
+      if (candidate < currIt)
+
+        candidate = nextLiteral(currIt, last);
+
+      if (candidate == last)
+
+        return match;
+
+      if (filter.literal.prefix)
+
+        currIt = candidate;
+
+      else if (!filter.prefixes.empty())
 
-std::unique_ptr<FA> NFA::makeDeterministic() const {
+        currIt = nextPrefix(currIt, last);
 
-  FABuilder faBuilder;
+      if (currIt == last)
 
-  std::vector<std::set<state_type>> stateStack;
-  std::vector<state_type> eps_init = epsilon_closure(initial_state);
+        return match;
+    }
+
+    if (!found && currIt != last) {
+
+      const size_t before = currStates.size();
 
-  stateStack.emplace_back(std::begin(eps_init),
-                          std::end(eps_init));
+      addClosure(currStates, initial_state);
+
+      for (size_t i = before; i < currStates.size(); ++i)
+
+        currStarts[currStates[i]] = currIt;
+    }
 
-  faBuilder.initial_state(state_from_set(stateStack.back()));
+    /* The first final thread has the leftmost start. Threads which started
+     * after it can no longer win, but earlier ones still might, and so might
+     * ones which started with it if they can make the match longer.
+     */
+    for (size_t i = 0; i < currStates.size(); ++i) {
 
-  for (size_t currState = 0; currState < stateStack.size(); ++currState) {
+      if (!accepting[currStates[i]]) continue;
 
-    for (size_t i = 0; i < symbols.size(); ++i) {
+      const InputIterator start = currStarts[currStates[i]];
 
-      if (symbols[i] == EPSILON) continue;
+      found = true;
+      match = {start, currIt};
 
-      const symbol_type symbol = symbols[i];
-      const std::set<state_type> startState = stateStack[currState];
-      const std::set<state_type> endState = delta(startState, symbol);
+      nextStates.clear();
 
-      if (std::find(std::begin(stateStack), std::end(stateStack), endState) == 
-                    std::end(stateStack)) {
+      for (size_t j = 0; j < currStates.size(); ++j) {
 
-        stateStack.push_back(endState);
+        const state_type& q = currStates[j];
 
-        if (std::find_first_of( std::begin(final_states),
-                                std::end(final_states),
-                                std::begin(endState), std::end(endState)) !=
-            std::end(final_states))
+        /* Threads before i started no later than it, and those after it with
+         * a different start started later.
+         */
+        if (currStarts[q] == start ? !longest : j > i) break;
 
-          faBuilder.final_state(state_from_set(endState));
+        nextStates.insert(q);
       }
 
-      faBuilder.transition( state_from_set(startState), symbol,
-                            state_from_set(endState));
+      std::swap(currStates, nextStates);
+
+      break;
     }
-  }
 
-  return faBuilder.build();
+    if ((found && currStates.empty()) || currIt == last)
+
+      return match;
+
+    const size_t c = byte_classes.classOf[static_cast<unsigned char>(*currIt)];
+
+    nextStates.clear();
+
+    for (const state_type& q : currStates) {
+
+      const size_t row = q * byte_classes.count + c;
+
+      for (size_t i = step_offsets[row]; i < step_offsets[row + 1]; ++i) {
+
+        const size_t before = nextStates.size();
+
+        addClosure(nextStates, step_targets[i]);
+
+        for (size_t j = before; j < nextStates.size(); ++j)
+
+          nextStarts[nextStates[j]] = currStarts[q];
+      }
+    }
+
+    std::swap(currStates, nextStates);
+    std::swap(currStarts, nextStarts);
+  }
 }
 
-template <typename InputIterator>
-std::set<FA::state_type> NFA::delta(const std::set<state_type>& qs, 
-                                    InputIterator first,
-                                    InputIterator last) const {
- 
-  if (first == last) return qs;
+/**
+ * Adds the EPSILON closure of q to states.
+ *
+ * Sets only ever receive whole closures, so if q is already present then so
+ * is everything reachable from it.
+ *
+ * @param states The set to add to.
+ * @param q      The state to start from.
+ */
+void NFA::addClosure(SparseSet& states, const state_type& q) const {
 
-  return delta(delta(qs, *first), first + 1, last);
+  if (!states.insert(q)) return;
+
+  for (size_t i = closure_offsets[q] + 1; i < closure_offsets[q + 1]; ++i)
+
+    states.insert(closure_states[i]);
 }
 
-std::set<FA::state_type> NFA::delta(const std::set<state_type>& qs,
-                                    const symbol_type& a) const {
+void NFA::startStates(std::vector<state_type>& out) const {
+
+  SparseSet& states = Scratch::set(Scratch::NFA_CURRENT, state_count);
 
-  std::set<state_type> eps_set, end_states, eps_end_states;
+  addClosure(states, initial_state);
 
-  size_t index = std::distance( std::begin(symbols),
-                                std::find(std::begin(symbols),
-                                          std::end(symbols),
-                                          a));
+  out.insert(std::end(out), std::begin(states), std::end(states));
+}
 
-  if (index == symbols.size())
+void NFA::step( const state_type& q, const symbol_type& a,
+                std::vector<state_type>& out) const {
 
-    return {};
+  if (a == EPSILON) return;
 
-  for (const state_type& q : qs)
+  SparseSet& states = Scratch::set(Scratch::NFA_CURRENT, state_count);
 
-    for (const state_type& q_eps : epsilon_closure(q))
+  const size_t row = q * byte_classes.count +
+                     byte_classes.classOf[static_cast<unsigned char>(a)];
 
-      eps_set.insert(q_eps);
+  for (size_t i = step_offsets[row]; i < step_offsets[row + 1]; ++i)
 
-  for (const std::pair<state_type, state_type>& pair : transitions[index])
+    addClosure(states, step_targets[i]);
 
-    if (eps_set.find(pair.first) != std::end(eps_set))
+  out.insert(std::end(out), std::begin(states), std::end(states));
+}
 
-      end_states.insert(pair.second);
+std::unique_ptr<FA> NFA::normalize(ThreadPool& pool) const {
 
-  for (const state_type& q : end_states)
+  return FA::normalize(makeDeterministic(pool), pool);
+}
 
-    for (const state_type& q_eps : epsilon_closure(q))
+std::unique_ptr<FA> NFA::makeDeterministic(ThreadPool& pool) const {
 
-      eps_end_states.insert(q_eps);
+  std::vector<std::vector<state_type>> subsets;
 
-  return eps_end_states;
+  return makeDeterministic(subsets, pool);
 }
 
-std::vector<FA::state_type> NFA::epsilon_closure(const state_type& q) const {
+/**
+ * Uses the subset construction to build a DFA which accepts the same language.
+ *
+ * Each subset is kept as a sorted vector of NFA states and looked up by hash,
+ * and DFA states are numbered in the order their subsets are first reached,
+ * so the initial state is 0. The empty subset is left out, since the DFA's
+ * dead state already stands for it.
+ *
+ * The search is breadth first and goes a level at a time, on the threads of
+ * pool. First the level's states are expanded on every byte
+ * class at once, while the subsets already numbered are only read. Then the
+ * new subsets are added to the shards of the table they hash to, one thread
+ * per shard. Last, they are numbered in order of the state and class they
+ * were reached from, which is the order a one-state-at-a-time search would
+ * reach them in, so the DFA is the same however many threads there are.
+ *
+ * @param  subsets Receives the EPSILON-closed set of NFA states behind each
+ *                 state of the DFA.
+ * @param  pool    The threads to use.
+ * @return         The DFA.
+ */
+std::unique_ptr<FA> NFA::makeDeterministic(
+  std::vector<std::vector<state_type>>& subsets, ThreadPool& pool) const {
+
+  const state_type NO_STATE   = static_cast<state_type>(-1);
+  const state_type UNNUMBERED = static_cast<state_type>(-2);
+
+  const size_t SHARDS = 64;
+
+  /* States of a level expanded by one task. */
+  const size_t BLOCK = 16;
+
+  /* New subsets in a level worth adding to the shards in parallel. */
+  const size_t MIN_PARALLEL_ADDS = 1024;
+
+  /* A transition found while expanding a level. */
+  struct Successor {
+
+    state_type from;
+    unsigned char byteClass;
+    unsigned char shard;
+
+    /* UNNUMBERED until a new subset has been numbered. */
+    state_type id;
+
+    /* A new subset, its number's place in its shard, and whether this is
+     * where the level reached it first.
+     */
+    std::vector<state_type> subset;
+    state_type* slot;
+    bool first;
+  };
+
+  std::vector<std::unordered_map<std::vector<state_type>, state_type,
+                                 StateSetHash>> ids(SHARDS);
+
+  /* The DFA's transitions on each byte class. */
+  std::vector<std::vector<std::pair<state_type, state_type>>>
+    classTransitions(byte_classes.count);
+
+  subsets.assign(1, epsilon_closure(initial_state));
+
+  std::sort(std::begin(subsets[0]), std::end(subsets[0]));
+
+  ids[StateSetHash()(subsets[0]) % SHARDS].emplace(subsets[0], 0);
+
+  std::vector<std::vector<Successor>> blocks;
+  std::vector<std::vector<Successor*>> adds(SHARDS);
+
+  for (size_t levelBegin = 0, levelEnd = 1; levelBegin < levelEnd;
+       levelBegin = levelEnd, levelEnd = subsets.size()) {
+
+    blocks.assign((levelEnd - levelBegin + BLOCK - 1) / BLOCK,
+                  std::vector<Successor>());
+
+    pool.parallelFor(blocks.size(), 1, [&] (const size_t& firstBlock,
+                                            const size_t& lastBlock) {
+
+      SparseSet& nextStates = Scratch::set(Scratch::NFA_CURRENT, state_count);
+      std::vector<state_type> nextSubset;
+
+      for (size_t b = firstBlock; b < lastBlock; ++b)
+
+        for (size_t q = levelBegin + b * BLOCK;
+             q < std::min(levelBegin + (b + 1) * BLOCK, levelEnd); ++q)
+
+          for (size_t c = 1; c < byte_classes.count; ++c) {
+
+            nextStates.clear();
+            delta(subsets[q], c, nextStates);
+
+            if (nextStates.empty()) continue;
+
+            nextSubset.assign(std::begin(nextStates), std::end(nextStates));
+
+            std::sort(std::begin(nextSubset), std::end(nextSubset));
+
+            const size_t shard = StateSetHash()(nextSubset) % SHARDS;
 
-  std::vector<state_type> eps_cls {q};
+            auto it = ids[shard].find(nextSubset);
 
-  size_t index = std::distance( std::begin(symbols), 
-                                std::find(std::begin(symbols), 
-                                          std::end(symbols), 
-                                          EPSILON));
+            blocks[b].push_back({static_cast<state_type>(q),
+                                 static_cast<unsigned char>(c),
+                                 static_cast<unsigned char>(shard),
+                                 it == std::end(ids[shard]) ?
+                                   UNNUMBERED : it->second,
+                                 std::vector<state_type>(), nullptr, false});
 
-  if (index == symbols.size())
+            if (it == std::end(ids[shard]))
 
-    return eps_cls;
+              blocks[b].back().subset = nextSubset;
+          }
+    });
 
-  for (size_t currState = 0; currState < eps_cls.size(); ++currState)
+    size_t added = 0;
 
-    for (const std::pair<state_type, state_type>& pair : transitions[index])
+    for (std::vector<Successor*>& shardAdds : adds)
 
-      if (pair.first == eps_cls[currState] &&
-          std::find(std::begin(eps_cls), std::end(eps_cls), pair.second) ==
-          std::end(eps_cls))
+      shardAdds.clear();
 
-        eps_cls.push_back(pair.second);
+    for (std::vector<Successor>& block : blocks)
+
+      for (Successor& successor : block)
+
+        if (successor.id == UNNUMBERED) {
+
+          adds[successor.shard].push_back(&successor);
+          ++added;
+        }
+
+    pool.parallelFor(SHARDS, added < MIN_PARALLEL_ADDS ? SHARDS : 1,
+                     [&] (const size_t& firstShard, const size_t& lastShard) {
+
+      for (size_t shard = firstShard; shard < lastShard; ++shard)
+
+        for (Successor* successor : adds[shard]) {
+
+          auto inserted = ids[shard].emplace(successor->subset, NO_STATE);
+
+          successor->slot  = &inserted.first->second;
+          successor->first = inserted.second;
+        }
+    });
+
+    for (std::vector<Successor>& block : blocks)
+
+      for (Successor& successor : block) {
+
+        if (successor.id == UNNUMBERED) {
+
+          if (successor.first) {
+
+            *successor.slot = subsets.size();
+            subsets.push_back(std::move(successor.subset));
+          }
+
+          successor.id = *successor.slot;
+        }
+
+        classTransitions[successor.byteClass].push_back({successor.from,
+                                                         successor.id});
+      }
+  }
+
+  /* Byte classes which lead nowhere in the DFA join class 0. */
+  ByteClasses newByteClasses;
+  std::vector<unsigned char> renumber(byte_classes.count, 0);
+
+  newByteClasses.count = 1;
+
+  for (size_t c = 1; c < byte_classes.count; ++c)
+
+    if (!classTransitions[c].empty())
+
+      renumber[c] = newByteClasses.count++;
+
+  for (size_t b = 0; b < newByteClasses.classOf.size(); ++b)
+
+    newByteClasses.classOf[b] = renumber[byte_classes.classOf[b]];
+
+  std::vector<symbol_type> newSymbols;
+  std::vector<std::vector<std::pair<state_type, state_type>>> newTransitions;
+  std::vector<state_type> newFinalStates;
+
+  for (const symbol_type& symbol : symbols) {
+
+    const size_t c = byte_classes.classOf[static_cast<unsigned char>(symbol)];
+
+    if (renumber[c] == 0) continue;
+
+    newSymbols.push_back(symbol);
+    newTransitions.push_back(classTransitions[c]);
+  }
+
+  for (size_t q = 0; q < subsets.size(); ++q)
+
+    if (std::any_of(std::begin(subsets[q]), std::end(subsets[q]),
+                    [this] (const state_type& p) -> bool {
+
+                      return accepting[p];
+                    }))
+
+      newFinalStates.push_back(q);
+
+  return std::unique_ptr<FA>(new DFA( 0, newFinalStates, newSymbols,
+                                      newTransitions, newByteClasses));
+}
+
+/**
+ * Adds to out the EPSILON closure of every successor of states on a byte
+ * class.
+ *
+ * @param states    The states to move from.
+ * @param byteClass The byte class to move on.
+ * @param out       The set to add to.
+ */
+void NFA::delta(const std::vector<state_type>& states, const size_t& byteClass,
+                SparseSet& out) const {
+
+  for (const state_type& q : states) {
+
+    const size_t row = q * byte_classes.count + byteClass;
+
+    for (size_t i = step_offsets[row]; i < step_offsets[row + 1]; ++i)
+
+      addClosure(out, step_targets[i]);
+  }
+}
+
+std::vector<FA::state_type> NFA::epsilon_closure(const state_type& q) const {
 
-  return eps_cls;
+  return std::vector<state_type>(std::begin(closure_states) + closure_offsets[q],
+                                 std::begin(closure_states) + closure_offsets[q + 1]);
 }
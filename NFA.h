@@ -1,8 +1,9 @@
 #pragma once
 
 #include "FA.h"
+#include "SparseSet.h"
 
-#include <set>
+#include <vector>
 
 class NFA :
   public FA {
@@ -18,32 +19,73 @@ public:
   virtual bool match( std::string::const_iterator,
                       std::string::const_iterator) const;
 
+  virtual MatchStatus matchStatus(const char*, const size_t&) const;
+
   virtual std::pair<const char*, const size_t> findNext(const char*, 
                                                         const size_t&) const;
 
   virtual std::pair<std::string::const_iterator, std::string::const_iterator>
     findNext(std::string::const_iterator, std::string::const_iterator) const;
 
+  friend class FA;
   friend class FABuilder;
   friend class DFA;
+  friend class LazyDFA;
+  friend class RegexSet;
 
 private:
 
   NFA(const state_type& initial_state,
       const std::vector<state_type>& final_states,
       const std::vector<symbol_type>& symbols,
-      const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions) :
-    FA(initial_state, final_states, symbols, transitions) {}
+      const std::vector<std::vector<std::pair<state_type, state_type>>>& transitions,
+      const ByteClasses& byte_classes);
+
+
+  virtual void startStates(std::vector<state_type>&) const;
+  virtual void step(const state_type&, const symbol_type&,
+                    std::vector<state_type>&) const;
 
+  virtual std::unique_ptr<FA> normalize(ThreadPool&) const;
 
-  virtual std::unique_ptr<FA> normalize()         const;
+          std::unique_ptr<FA> makeDeterministic(ThreadPool&) const;
+          std::unique_ptr<FA> makeDeterministic(
+            std::vector<std::vector<state_type>>&, ThreadPool&) const;
+
+  template <typename InputIterator>
+  MatchStatus simulate(InputIterator, InputIterator) const;
+  template <typename InputIterator>
+  MatchStatus simulate(SparseSet&, InputIterator, InputIterator) const;
 
-          std::unique_ptr<FA> makeDeterministic() const;
+  virtual std::pair<const char*, const char*>
+    find(const char*, const char*, const MatchSemantics&) const;
+  virtual std::pair<std::string::const_iterator, std::string::const_iterator>
+    find( std::string::const_iterator, std::string::const_iterator,
+          const MatchSemantics&) const;
 
   template <typename InputIterator>
-  std::set<state_type>    delta(const std::set<state_type>&, 
-                                InputIterator, InputIterator) const;
-  std::set<state_type>    delta(const std::set<state_type>&, 
-                                const symbol_type&) const;
+  std::pair<InputIterator, InputIterator> search(InputIterator, InputIterator,
+                                                 const MatchSemantics&) const;
+
+  void addClosure(SparseSet&, const state_type&) const;
+
+  void                    delta(const std::vector<state_type>&, const size_t&,
+                                SparseSet&) const;
   std::vector<state_type> epsilon_closure(const state_type&) const;
+
+  /* Transitions in compressed sparse row form. The successors of state q on
+   * byte class c are step_targets[step_offsets[r]] up to (but not including)
+   * step_targets[step_offsets[r + 1]], where r = q * byte_classes.count + c.
+   * EPSILON transitions are kept the same way, with one row per state.
+   */
+  std::vector<size_t>     step_offsets;
+  std::vector<state_type> step_targets;
+  std::vector<size_t>     eps_offsets;
+  std::vector<state_type> eps_targets;
+
+  /* The EPSILON closure of every state, in the same form. */
+  std::vector<size_t>     closure_offsets;
+  std::vector<state_type> closure_states;
+
+  std::vector<char>       accepting;
 };
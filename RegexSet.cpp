@@ -0,0 +1,169 @@
+#include "RegexSet.h"
+
+#include "NFA.h"
+#include "FABuilder.h"
+#include "ThreadPool.h"
+
+#include <map>
+#include <limits>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+
+/**
+ * Compiles the regexes into one DFA.
+ *
+ * @param patterns     The regexes. Pattern i is reported at index i.
+ * @param construction How each regex is turned into an automaton first.
+ */
+RegexSet::RegexSet(const std::vector<std::string>& patterns,
+                   const Construction& construction) :
+  patternCount(patterns.size()),
+  matchSets(1, std::vector<bool>(patterns.size(), false)) {
+
+  const size_t NO_PATTERN = static_cast<size_t>(-1);
+
+  /* Transitions by symbol, indexed by the symbol as an unsigned char. */
+  std::vector<std::vector<std::pair<FA::state_type, FA::state_type>>> bySymbol(256);
+
+  std::vector<FA::state_type> finalStates;
+  std::vector<size_t> patternOf;
+
+  std::vector<FA::state_type> initialStates;
+
+  for (size_t i = 0; i < patterns.size(); ++i) {
+
+    const std::unique_ptr<FA> fa = FA::fromRegex(patterns[i], construction);
+    const FA::state_type offset = patternOf.size();
+
+    patternOf.resize(offset + fa->state_count, NO_PATTERN);
+    initialStates.push_back(offset + fa->initial_state);
+
+    for (size_t j = 0; j < fa->symbols.size(); ++j)
+
+      for (const std::pair<FA::state_type, FA::state_type>& pair : fa->transitions[j])
+
+        bySymbol[static_cast<unsigned char>(fa->symbols[j])].emplace_back(
+          offset + pair.first, offset + pair.second);
+
+    for (const FA::state_type& f : fa->final_states) {
+
+      finalStates.push_back(offset + f);
+      patternOf[offset + f] = i;
+    }
+  }
+
+  /* The new initial state leads to each regex's initial state. */
+  const FA::state_type q_0 = patternOf.size();
+
+  for (const FA::state_type& q : initialStates)
+
+    bySymbol[static_cast<unsigned char>(EPSILON)].emplace_back(q_0, q);
+
+  std::vector<FA::symbol_type> symbols;
+  std::vector<std::vector<std::pair<FA::state_type, FA::state_type>>> transitions;
+
+  for (int c = std::numeric_limits<FA::symbol_type>::min();
+       c <= std::numeric_limits<FA::symbol_type>::max(); ++c) {
+
+    std::vector<std::pair<FA::state_type, FA::state_type>>& pairs =
+      bySymbol[static_cast<unsigned char>(c)];
+
+    if (pairs.empty()) continue;
+
+    std::sort(std::begin(pairs), std::end(pairs));
+
+    symbols.push_back(static_cast<FA::symbol_type>(c));
+    transitions.push_back(std::move(pairs));
+  }
+
+  const NFA nfa(q_0, finalStates, symbols, transitions,
+                FABuilder::byteClasses(symbols, transitions));
+
+  std::vector<std::vector<FA::state_type>> subsets;
+
+  std::unique_ptr<FA> deterministic =
+    nfa.makeDeterministic(subsets, ThreadPool::shared());
+
+  dfa.reset(static_cast<DFA*>(deterministic.release()));
+
+  /* Tag each DFA state with the regexes whose final states it contains. */
+  std::map<std::vector<bool>, size_t> matchSetIds {{matchSets.front(), 0}};
+
+  matchSetOf.assign(dfa->state_count + 1, 0);
+
+  for (size_t q = 0; q < subsets.size(); ++q) {
+
+    std::vector<bool> matched(patternCount, false);
+
+    for (const FA::state_type& p : subsets[q])
+
+      if (p < patternOf.size() && patternOf[p] != NO_PATTERN)
+
+        matched[patternOf[p]] = true;
+
+    auto inserted = matchSetIds.emplace(matched, matchSets.size());
+
+    if (inserted.second)
+
+      matchSets.push_back(std::move(matched));
+
+    matchSetOf[q] = inserted.first->second;
+  }
+}
+
+/**
+ * Matches a string against every regex.
+ *
+ * @param  arr The string.
+ * @param  n   Its length.
+ * @return     Element i is true if regex i matches the whole string.
+ */
+std::vector<bool> RegexSet::match(const char* arr, const size_t& n) const {
+
+  return run(arr, arr + n);
+}
+
+std::vector<bool> RegexSet::match(std::string::const_iterator first,
+                                  std::string::const_iterator last) const {
+
+  return run(first, last);
+}
+
+/**
+ * Matches a string against every regex.
+ *
+ * @param arr     The string.
+ * @param n       Its length.
+ * @param matched Receives size() elements, where element i is true if regex
+ *                i matches the whole string.
+ */
+void RegexSet::match(const char* arr, const size_t& n,
+                     std::vector<bool>& matched) const {
+
+  const std::vector<bool>& result = run(arr, arr + n);
+
+  matched.assign(std::begin(result), std::end(result));
+}
+
+void RegexSet::match(std::string::const_iterator first,
+                     std::string::const_iterator last,
+                     std::vector<bool>& matched) const {
+
+  const std::vector<bool>& result = run(first, last);
+
+  matched.assign(std::begin(result), std::end(result));
+}
+
+size_t RegexSet::size() const {
+
+  return patternCount;
+}
+
+template <typename InputIterator>
+const std::vector<bool>& RegexSet::run(InputIterator first,
+                                       InputIterator last) const {
+
+  return matchSets[matchSetOf[dfa->delta(dfa->initial_state, first, last)]];
+}
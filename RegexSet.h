@@ -0,0 +1,57 @@
+#pragma once
+
+#include "FA.h"
+#include "DFA.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+
+/**
+ * Matches a string against many regexes at once.
+ *
+ * The regexes are combined like FA::alternate, with one new initial state,
+ * and determinized into a single DFA. Each DFA state remembers which of the
+ * regexes' final states it contains, so one pass over the input tells which
+ * regexes match it as a whole, just as FA::match would for each of them.
+ */
+class RegexSet {
+
+public:
+
+  RegexSet() = delete;
+
+  explicit RegexSet(const std::vector<std::string>&,
+                    const Construction& = Construction::THOMPSON);
+
+  std::vector<bool> match(const char*, const size_t&) const;
+
+  std::vector<bool> match(std::string::const_iterator,
+                          std::string::const_iterator) const;
+
+  /* As above, into a vector which can be reused from one string to the next,
+   * so that matching does not allocate.
+   */
+  void match(const char*, const size_t&, std::vector<bool>&) const;
+
+  void match(std::string::const_iterator, std::string::const_iterator,
+             std::vector<bool>&) const;
+
+  /* The number of regexes. */
+  size_t size() const;
+
+private:
+
+  template <typename InputIterator>
+  const std::vector<bool>& run(InputIterator, InputIterator) const;
+
+  size_t patternCount;
+
+  std::unique_ptr<DFA> dfa;
+
+  /* The regexes which accept in each state of dfa, indexed by
+   * matchSetOf[state]. Identical sets are only stored once.
+   */
+  std::vector<std::vector<bool>> matchSets;
+  std::vector<size_t>            matchSetOf;
+};
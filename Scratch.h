@@ -0,0 +1,64 @@
+#pragma once
+
+#include "SparseSet.h"
+
+#include <vector>
+
+/**
+ * Working space for matching, kept for each thread from one match to the
+ * next.
+ *
+ * Each thread has its own, so threads can match with one FA at once, and
+ * once a thread has used an FA this big, matching allocates nothing. Each
+ * slot is a separate piece of space; code which might be running at once on
+ * one thread uses different slots.
+ */
+class Scratch {
+
+public:
+
+  enum Slot {
+
+    NFA_CURRENT, // The Pike VM's sets, and NFA::startStates and NFA::step.
+    NFA_NEXT,
+    DFA_CURRENT, // DFA::searchThreads.
+    DFA_NEXT,
+    SLOTS
+  };
+
+  /**
+   * @param  slot     Which set.
+   * @param  capacity The number of states needed.
+   * @return          The set, empty and with room for capacity states.
+   */
+  static SparseSet& set(const Slot& slot, const size_t& capacity) {
+
+    static thread_local std::vector<SparseSet> sets(SLOTS, SparseSet(0));
+
+    if (sets[slot].capacity() < capacity)
+
+      sets[slot] = SparseSet(capacity);
+
+    sets[slot].clear();
+
+    return sets[slot];
+  }
+
+  /**
+   * @param  slot Which vector.
+   * @param  size The number of elements needed.
+   * @return      The vector, with at least size elements, which hold whatever
+   *              they were last given.
+   */
+  template <typename T>
+  static std::vector<T>& vector(const Slot& slot, const size_t& size) {
+
+    static thread_local std::vector<std::vector<T>> vectors(SLOTS);
+
+    if (vectors[slot].size() < size)
+
+      vectors[slot].resize(size);
+
+    return vectors[slot];
+  }
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "FA.h"
+
+#include <vector>
+
+/**
+ * A set of states drawn from [0, capacity), with O(1) insert, lookup and
+ * clear, which remembers the order in which states were inserted.
+ *
+ * This is the usual pair of dense and sparse arrays: sparse[q] is only
+ * trusted if it points at a slot of dense which points back at q, so neither
+ * array ever has to be reset.
+ */
+class SparseSet {
+
+public:
+
+  typedef std::vector<FA::state_type>::const_iterator const_iterator;
+
+  explicit SparseSet(const size_t& capacity) :
+    dense(capacity),
+    sparse(capacity),
+    count(0) {}
+
+  bool contains(const FA::state_type& q) const {
+
+    const size_t i = sparse[q];
+
+    return i < count && dense[i] == q;
+  }
+
+  /* Returns false if q was already in the set. */
+  bool insert(const FA::state_type& q) {
+
+    if (contains(q)) return false;
+
+    sparse[q] = count;
+    dense[count++] = q;
+
+    return true;
+  }
+
+  void clear() { count = 0; }
+
+  bool   empty()    const { return count == 0; }
+  size_t size()     const { return count; }
+  size_t capacity() const { return dense.size(); }
+
+  const FA::state_type& operator [] (const size_t& i) const { return dense[i]; }
+
+  const_iterator begin() const { return dense.begin(); }
+  const_iterator end()   const { return dense.begin() + count; }
+
+private:
+
+  std::vector<FA::state_type> dense;
+  std::vector<size_t>         sparse;
+  size_t count;
+};
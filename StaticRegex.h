@@ -0,0 +1,705 @@
+#pragma once
+
+#include "FAExcept.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+
+#if __cplusplus < 201402L
+#error "StaticRegex.h needs C++14, for loops and branches in constexpr functions."
+#endif
+
+/* A set of bytes, usable in constant expressions. */
+struct StaticSymbols {
+
+  constexpr StaticSymbols() :
+    words() {}
+
+  std::uint64_t words[4];
+
+  constexpr void set(const unsigned& c) {
+
+    words[c >> 6] |= std::uint64_t(1) << (c & 63);
+  }
+
+  constexpr bool test(const unsigned& c) const {
+
+    return (words[c >> 6] >> (c & 63)) & 1;
+  }
+};
+
+/**
+ * The Glushkov automaton of a regex, built by a constexpr parser for the
+ * grammar of faParse.cpp.
+ *
+ * Position 0 stands for the initial state, and positions 1 to MAX_POSITIONS
+ * for the symbol sets of the regex, so that a set of states is one 64-bit
+ * mask. A bounded repetition copies its operand by parsing it again, as
+ * evaluate does in faParse.cpp, so every copy counts against the limit.
+ */
+class StaticGlushkov {
+
+public:
+
+  static constexpr size_t MAX_POSITIONS = 63;
+
+  /* {m,} has no upper bound. */
+  static constexpr unsigned UNBOUNDED = static_cast<unsigned>(-1);
+
+  /**
+   * @param regex The regex, which must be a null terminated string.
+   * @throws BadParse If it is not a valid regex.
+   * @throws std::length_error If it has more than MAX_POSITIONS symbol sets.
+   */
+  constexpr explicit StaticGlushkov(const char* regex) :
+    symbols(),
+    follow(),
+    accepting(0),
+    positions(1),
+    regex(regex),
+    length(0),
+    at(0) {
+
+    while (regex[length] != '\0')
+
+      ++length;
+
+    const Fragment fragment = alternation();
+
+    /* Only a ')' without a '(' can stop the outermost alternation early. */
+    if (at != length)
+
+      throw BadParse();
+
+    follow[0] = fragment.first;
+    accepting = fragment.last | (fragment.nullable ? 1 : 0);
+  }
+
+  /* The symbols of each position. */
+  StaticSymbols symbols[MAX_POSITIONS + 1];
+
+  /* The positions which can follow each position. */
+  std::uint64_t follow[MAX_POSITIONS + 1];
+
+  /* The positions a match can end in. */
+  std::uint64_t accepting;
+
+  /* The number of positions, counting position 0. */
+  size_t positions;
+
+private:
+
+  struct Fragment {
+
+    std::uint64_t first, last;
+    bool nullable;
+  };
+
+  static constexpr Fragment empty() {
+
+    return {0, 0, true};
+  }
+
+  constexpr void link(const std::uint64_t& from, const std::uint64_t& to) {
+
+    for (size_t p = 0; p < positions; ++p)
+
+      if ((from >> p) & 1)
+
+        follow[p] |= to;
+  }
+
+  constexpr Fragment concatenate(const Fragment& a, const Fragment& b) {
+
+    link(a.last, b.first);
+
+    return {a.first | (a.nullable ? b.first : 0),
+            b.last  | (b.nullable ? a.last  : 0),
+            a.nullable && b.nullable};
+  }
+
+  static constexpr Fragment alternate(const Fragment& a, const Fragment& b) {
+
+    return {a.first | b.first, a.last | b.last, a.nullable || b.nullable};
+  }
+
+  constexpr Fragment plus(const Fragment& a) {
+
+    link(a.last, a.first);
+
+    return a;
+  }
+
+  constexpr Fragment star(const Fragment& a) {
+
+    link(a.last, a.first);
+
+    return {a.first, a.last, true};
+  }
+
+  static constexpr Fragment optional(const Fragment& a) {
+
+    return {a.first, a.last, true};
+  }
+
+  constexpr Fragment position(const StaticSymbols& set) {
+
+    if (positions > MAX_POSITIONS)
+
+      throw std::length_error("Too many symbols for a StaticRegex.");
+
+    symbols[positions] = set;
+
+    const std::uint64_t bit = std::uint64_t(1) << positions++;
+
+    return {bit, bit, false};
+  }
+
+  constexpr Fragment symbol(const unsigned char& c) {
+
+    StaticSymbols set;
+
+    set.set(c);
+
+    return position(set);
+  }
+
+  constexpr Fragment alternation() {
+
+    Fragment fragment = concatenation();
+
+    while (at < length && regex[at] == '|') {
+
+      ++at;
+      fragment = alternate(fragment, concatenation());
+    }
+
+    return fragment;
+  }
+
+  constexpr Fragment concatenation() {
+
+    Fragment fragment = empty();
+
+    while (at < length && regex[at] != '|' && regex[at] != ')')
+
+      fragment = concatenate(fragment, operand(at, length));
+
+    return fragment;
+  }
+
+  /**
+   * Parses one operand, with its postfix operators, starting at from and
+   * stopping at to, or at the first thing which is not a postfix operator.
+   * Bounds make the rest of the copies by parsing [from, bounds) again.
+   * from is taken by value, since it is usually at itself.
+   */
+  constexpr Fragment operand(const size_t from, const size_t to) {
+
+    at = from;
+
+    Fragment fragment = atom();
+
+    while (at < to) {
+
+      const size_t end = at;
+
+      unsigned min = 0, max = 0;
+
+      switch (regex[at]) {
+
+      case '*' :
+        ++at;
+        fragment = star(fragment);
+        break;
+
+      case '+' :
+        ++at;
+        fragment = plus(fragment);
+        break;
+
+      case '?' :
+        ++at;
+        fragment = optional(fragment);
+        break;
+
+      case '{' :
+        if (!bounds(min, max))
+
+          return fragment;
+
+        fragment = bounded(fragment, from, end, min, max);
+        break;
+
+      default :
+        return fragment;
+      }
+    }
+
+    return fragment;
+  }
+
+  /**
+   * x{m,n} becomes m copies followed by n - m nested optional ones, and x{m,}
+   * ends in x+ (or x* if m is 0), exactly as in faParse.cpp. The operand
+   * already parsed is the first copy.
+   */
+  constexpr Fragment bounded(const Fragment& operand, const size_t& from,
+                             const size_t& end, const unsigned& min,
+                             const unsigned& max) {
+
+    const size_t next = at;
+
+    bool fresh = true;
+
+    if (min == 0 && max == UNBOUNDED)
+
+      return star(operand);
+
+    Fragment fragment = empty();
+
+    for (unsigned i = 0; i < min; ++i) {
+
+      Fragment copy = this->copy(operand, fresh, from, end);
+
+      if (i + 1 == min && max == UNBOUNDED)
+
+        copy = plus(copy);
+
+      fragment = concatenate(fragment, copy);
+    }
+
+    if (max != UNBOUNDED) {
+
+      Fragment tail = empty();
+
+      for (unsigned i = min; i < max; ++i)
+
+        tail = optional(concatenate(copy(operand, fresh, from, end), tail));
+
+      fragment = concatenate(fragment, tail);
+    }
+
+    at = next;
+
+    return fragment;
+  }
+
+  constexpr Fragment copy(const Fragment& operand, bool& fresh,
+                          const size_t& from, const size_t& end) {
+
+    if (fresh) {
+
+      fresh = false;
+
+      return operand;
+    }
+
+    return this->operand(from, end);
+  }
+
+  constexpr Fragment atom() {
+
+    unsigned min = 0, max = 0;
+
+    switch (regex[at]) {
+
+    case '(' : {
+
+      ++at;
+
+      const Fragment fragment = alternation();
+
+      if (at == length || regex[at] != ')')
+
+        throw BadParse();
+
+      ++at;
+
+      return fragment;
+    }
+
+    case '*' :
+    case '+' :
+    case '?' :
+      throw BadParse();
+
+    case '{' :
+      if (bounds(min, max))
+
+        throw BadParse();
+
+      return symbol(regex[at++]);
+
+    case '[' :
+      ++at;
+
+      return position(bracket());
+
+    case '.' : {
+
+      ++at;
+
+      StaticSymbols set;
+
+      for (unsigned c = 0; c < 256; ++c)
+
+        if (c != '\n' && c != static_cast<unsigned char>(EPSILON))
+
+          set.set(c);
+
+      return position(set);
+    }
+
+    case '\\' :
+      if (++at == length)
+
+        throw BadParse();
+
+      return symbol(regex[at++]);
+
+    default :
+      return symbol(regex[at++]);
+    }
+  }
+
+  constexpr bool number(size_t& it, unsigned& n) const {
+
+    if (it == length || regex[it] < '0' || regex[it] > '9')
+
+      return false;
+
+    const unsigned largest = UNBOUNDED - 1;
+
+    for (n = 0; it < length && regex[it] >= '0' && regex[it] <= '9'; ++it)
+
+      n = n > (largest - (regex[it] - '0')) / 10 ?
+            largest : 10 * n + (regex[it] - '0');
+
+    return true;
+  }
+
+  /* Reads {m}, {m,} or {m,n} at the '{', leaving at alone if there is none. */
+  constexpr bool bounds(unsigned& min, unsigned& max) {
+
+    size_t curr = at + 1;
+
+    if (!number(curr, min))
+
+      return false;
+
+    max = min;
+
+    if (curr < length && regex[curr] == ',')
+
+      if (!number(++curr, max))
+
+        max = UNBOUNDED;
+
+    if (curr == length || regex[curr] != '}')
+
+      return false;
+
+    if (min > max)
+
+      throw BadParse();
+
+    /* More copies than this would be too many symbols, unless the operand
+     * is empty, and would take too long to make if it were.
+     */
+    if ((max == UNBOUNDED ? min : max) > MAX_POSITIONS)
+
+      throw std::length_error("Too many symbols for a StaticRegex.");
+
+    at = curr + 1;
+
+    return true;
+  }
+
+  constexpr unsigned char bracketSymbol() {
+
+    if (at == length || (regex[at] == '\\' && ++at == length))
+
+      throw BadParse();
+
+    return static_cast<unsigned char>(regex[at++]);
+  }
+
+  /* Reads a bracket expression, just past the '[', as lexClass does. */
+  constexpr StaticSymbols bracket() {
+
+    StaticSymbols set;
+
+    const bool negated = at < length && regex[at] == '^';
+
+    if (negated) ++at;
+
+    for (bool first = true; at == length || regex[at] != ']' || first;
+         first = false) {
+
+      const unsigned char lo = bracketSymbol();
+      unsigned char hi = lo;
+
+      if (at < length && regex[at] == '-' && at + 1 < length &&
+          regex[at + 1] != ']') {
+
+        ++at;
+        hi = bracketSymbol();
+
+        if (hi < lo)
+
+          throw BadParse();
+      }
+
+      for (unsigned c = lo; c <= hi; ++c)
+
+        set.set(c);
+    }
+
+    ++at;
+
+    if (negated)
+
+      for (std::uint64_t& word : set.words)
+
+        word = ~word;
+
+    set.words[0] &= ~(std::uint64_t(1) << static_cast<unsigned char>(EPSILON));
+
+    return set;
+  }
+
+  const char* regex;
+  size_t length;
+  size_t at;
+};
+
+/**
+ * The DFA of a regex, found by subset construction over its Glushkov
+ * automaton during compilation.
+ *
+ * Bytes which every position treats alike share a class, and class 0 has no
+ * transitions. State 0 is the initial state, and the dead state, which has no
+ * subset, is numbered state_count.
+ */
+class StaticAutomaton {
+
+public:
+
+  /* Past this, use FA::fromRegex, or CodeGenerator for a hardcoded DFA. */
+  static constexpr size_t MAX_STATES = 256;
+
+  /**
+   * @param regex The regex, which must be a null terminated string.
+   * @throws BadParse If it is not a valid regex.
+   * @throws std::length_error If its DFA has more than MAX_STATES states.
+   */
+  constexpr explicit StaticAutomaton(const char* regex) :
+    glushkov(regex),
+    classOf(),
+    signatures(),
+    subsets(),
+    state_count(1),
+    class_count(1) {
+
+    for (unsigned c = 0; c < 256; ++c) {
+
+      std::uint64_t signature = 0;
+
+      for (size_t p = 1; p < glushkov.positions; ++p)
+
+        if (glushkov.symbols[p].test(c))
+
+          signature |= std::uint64_t(1) << p;
+
+      size_t k = 0;
+
+      while (k < class_count && signatures[k] != signature)
+
+        ++k;
+
+      if (k == class_count)
+
+        signatures[class_count++] = signature;
+
+      classOf[c] = static_cast<unsigned char>(k);
+    }
+
+    subsets[0] = 1;
+
+    for (size_t q = 0; q < state_count; ++q)
+
+      for (size_t k = 1; k < class_count; ++k) {
+
+        const std::uint64_t subset = step(q, k);
+
+        if (subset == 0 || find(subset) != state_count)
+
+          continue;
+
+        if (state_count == MAX_STATES)
+
+          throw std::length_error("Too many states for a StaticRegex.");
+
+        subsets[state_count++] = subset;
+      }
+  }
+
+  /* The state reached from q on class k. */
+  constexpr size_t successor(const size_t& q, const size_t& k) const {
+
+    const std::uint64_t subset = step(q, k);
+
+    return subset == 0 ? state_count : find(subset);
+  }
+
+  constexpr bool accepts(const size_t& q) const {
+
+    return (subsets[q] & glushkov.accepting) != 0;
+  }
+
+  StaticGlushkov glushkov;
+
+  unsigned char classOf[256];
+
+  /* The positions each class can move to. */
+  std::uint64_t signatures[256];
+
+  std::uint64_t subsets[MAX_STATES];
+
+  size_t state_count;
+  size_t class_count;
+
+private:
+
+  constexpr std::uint64_t step(const size_t& q, const size_t& k) const {
+
+    std::uint64_t next = 0;
+
+    for (size_t p = 0; p < glushkov.positions; ++p)
+
+      if ((subsets[q] >> p) & 1)
+
+        next |= glushkov.follow[p];
+
+    return next & signatures[k];
+  }
+
+  constexpr size_t find(const std::uint64_t& subset) const {
+
+    size_t q = 0;
+
+    while (q < state_count && subsets[q] != subset)
+
+      ++q;
+
+    return q;
+  }
+};
+
+/* The tables of a StaticAutomaton, sized to fit it exactly. */
+template <typename State, size_t States, size_t Classes>
+struct StaticTable {
+
+  constexpr explicit StaticTable(const StaticAutomaton& automaton) :
+    classOf(),
+    next(),
+    accepting() {
+
+    for (unsigned c = 0; c < 256; ++c)
+
+      classOf[c] = automaton.classOf[c];
+
+    for (size_t q = 0; q < States; ++q) {
+
+      /* The last state is the dead one, which goes nowhere else. */
+      for (size_t k = 0; k < Classes; ++k)
+
+        next[q][k] = static_cast<State>(q + 1 == States || k == 0 ?
+                                          States - 1 :
+                                          automaton.successor(q, k));
+
+      accepting[q] = q + 1 != States && automaton.accepts(q);
+    }
+  }
+
+  unsigned char classOf[256];
+  State next[States][Classes];
+  bool accepting[States];
+};
+
+/**
+ * A regex compiled along with the program, for patterns known in advance.
+ *
+ * The pattern is given by a type with a static constexpr member regex, e.g.
+ *
+ *   struct Identifier {
+ *
+ *     static constexpr const char* regex = "[A-Za-z_][A-Za-z0-9_]*";
+ *   };
+ *
+ *   StaticRegex<Identifier>::match(str, n)
+ *
+ * The regex is parsed and determinized by the compiler, so a bad regex fails
+ * to compile, and matching is a loop over a constant table with no virtual
+ * calls, allocation or set up. match agrees with FA::match.
+ */
+template <typename Pattern>
+class StaticRegex {
+
+  static constexpr StaticAutomaton automaton =
+    StaticAutomaton(Pattern::regex);
+
+public:
+
+  /* The number of states, not counting the dead state. */
+  static constexpr size_t state_count = automaton.state_count;
+
+  typedef typename std::conditional<state_count < 256,
+                                    std::uint8_t,
+                                    std::uint16_t>::type state_type;
+
+  static bool match(const char* arr, const size_t& n) {
+
+    return run(arr, arr + n);
+  }
+
+  static bool match(std::string::const_iterator first,
+                    std::string::const_iterator last) {
+
+    return run(first, last);
+  }
+
+private:
+
+  typedef StaticTable<state_type, state_count + 1, automaton.class_count>
+    table_type;
+
+  static constexpr table_type table = table_type(automaton);
+
+  template <typename InputIterator>
+  static bool run(InputIterator first, InputIterator last) {
+
+    state_type q = 0;
+
+    for (; first != last; ++first) {
+
+      q = table.next[q][table.classOf[static_cast<unsigned char>(*first)]];
+
+      if (q == state_count)
+
+        return false;
+    }
+
+    return table.accepting[q];
+  }
+};
+
+template <typename Pattern>
+constexpr StaticAutomaton StaticRegex<Pattern>::automaton;
+
+template <typename Pattern>
+constexpr typename StaticRegex<Pattern>::table_type StaticRegex<Pattern>::table;
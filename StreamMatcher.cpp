@@ -0,0 +1,207 @@
+#include "StreamMatcher.h"
+#include "DFA.h"
+
+#include <vector>
+#include <algorithm>
+#include <iterator>
+
+StreamMatcher::StreamMatcher(const FA& fa, const callback_type& onMatch) :
+  fa(fa),
+  onMatch(onMatch),
+  dfa(dynamic_cast<const DFA*>(&fa)),
+  seen(fa.state_count, false) {
+
+  reset();
+}
+
+/**
+ * Discards all progress, so that the next call to feed() begins a new stream.
+ */
+void StreamMatcher::reset() {
+
+  offset = nextStart = 0;
+
+  threads.clear();
+  anchored.clear();
+
+  fa.startStates(anchored);
+
+  std::sort(std::begin(anchored), std::end(anchored));
+
+  anchored.erase( std::unique(std::begin(anchored), std::end(anchored)),
+                  std::end(anchored));
+}
+
+/**
+ * Consumes the next n bytes of the stream.
+ *
+ * Every match which ends within these bytes is reported before this returns.
+ *
+ * @param  arr The bytes.
+ * @param  n   The number of bytes.
+ * @return     This StreamMatcher.
+ */
+StreamMatcher& StreamMatcher::feed(const char* arr, size_t n) {
+
+  for (size_t i = 0; i < n; ++i) {
+
+    startThreads();
+    checkFinal();
+    stepThreads(arr[i]);
+    stepAnchored(arr[i]);
+
+    ++offset;
+
+    checkFinal();
+  }
+
+  return *this;
+}
+
+/**
+ * Ends the stream.
+ *
+ * Like FA::findNext, no match is started at the very end of the stream, so no
+ * empty match is reported there. The StreamMatcher is reset afterwards.
+ *
+ * @return Whether the FA accepts the stream as a whole.
+ */
+bool StreamMatcher::end() {
+
+  const bool accepted =
+    std::any_of(std::begin(anchored), std::end(anchored),
+                [this] (const FA::state_type& q) -> bool {
+
+                  return fa.isFinal(q);
+                });
+
+  reset();
+
+  return accepted;
+}
+
+/* Starts the threads for a match beginning at the current offset. */
+void StreamMatcher::startThreads() {
+
+  if (offset < nextStart) return;
+
+  stepped.clear();
+  fa.startStates(stepped);
+
+  for (const Thread& thread : threads)
+
+    seen[thread.state] = true;
+
+  for (const FA::state_type& q : stepped) {
+
+    if (!seen[q]) {
+
+      seen[q] = true;
+      threads.push_back({q, offset});
+    }
+  }
+
+  for (const Thread& thread : threads)
+
+    seen[thread.state] = false;
+}
+
+/**
+ * Reports a match if any thread is in a final state at the current offset.
+ *
+ * Threads are kept in order of their start offsets, so the first final one
+ * gives the leftmost start. Every thread is then discarded and the search
+ * starts over from the end of the match.
+ */
+void StreamMatcher::checkFinal() {
+
+  auto it = std::find_if( std::begin(threads), std::end(threads),
+                          [this] (const Thread& thread) -> bool {
+
+                            return fa.isFinal(thread.state);
+                          });
+
+  if (it == std::end(threads)) return;
+
+  const size_t matchStart = it->start;
+
+  threads.clear();
+
+  onMatch(matchStart, offset - matchStart);
+
+  /* An empty match must not be found again at the same offset. */
+  nextStart = offset > matchStart ? offset : offset + 1;
+
+  startThreads();
+  checkFinal();
+}
+
+/* Moves every thread over a, keeping only the earliest thread in each state. */
+void StreamMatcher::stepThreads(const FA::symbol_type& a) {
+
+  nextThreads.clear();
+
+  for (const Thread& thread : threads) {
+
+    stepped.clear();
+    step(thread.state, a, stepped);
+
+    for (const FA::state_type& q : stepped) {
+
+      if (!seen[q]) {
+
+        seen[q] = true;
+        nextThreads.push_back({q, thread.start});
+      }
+    }
+  }
+
+  for (const Thread& thread : nextThreads)
+
+    seen[thread.state] = false;
+
+  std::swap(threads, nextThreads);
+}
+
+void StreamMatcher::stepAnchored(const FA::symbol_type& a) {
+
+  stepped.clear();
+
+  for (const FA::state_type& q : anchored)
+
+    step(q, a, stepped);
+
+  anchored.clear();
+
+  for (const FA::state_type& q : stepped) {
+
+    if (!seen[q]) {
+
+      seen[q] = true;
+      anchored.push_back(q);
+    }
+  }
+
+  for (const FA::state_type& q : anchored)
+
+    seen[q] = false;
+}
+
+/* FA::step, without the virtual call for a DFA. */
+void StreamMatcher::step( const FA::state_type& q, const FA::symbol_type& a,
+                          std::vector<FA::state_type>& out) const {
+
+  if (!dfa) {
+
+    fa.step(q, a, out);
+    return;
+  }
+
+  const FA::state_type next =
+    dfa->table[q * dfa->byte_classes.count +
+               dfa->byte_classes.classOf[static_cast<unsigned char>(a)]];
+
+  if (next != dfa->dead_state)
+
+    out.push_back(next);
+}
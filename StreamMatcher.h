@@ -0,0 +1,87 @@
+#pragma once
+
+#include "FA.h"
+
+#include <vector>
+#include <functional>
+
+class DFA;
+
+/**
+ * Runs an FA over input which arrives in pieces.
+ *
+ * Bytes are handed over with feed() as they arrive, and no input is ever
+ * buffered, so memory use depends only on the size of the FA. Two things are
+ * tracked at once:
+ *
+ *  - Matches of the FA within the stream. Each match is reported to the
+ *    callback, as a stream offset and a length, as soon as its last byte has
+ *    been fed: it is the match which ends first, starting as far to the left
+ *    as possible. Searching then resumes at its end, so matches do not
+ *    overlap. Unlike FA::findNext, this never has to wait for (or buffer)
+ *    input beyond the end of a match. It is not a MatchSemantics: both of
+ *    those, including the LEFTMOST_LONGEST which FA::findAll and
+ *    FA::findNext use by default, take the leftmost start first, so for
+ *    abcd|c in "abcd" they find abcd where this reports c.
+ *  - Whether the stream as a whole is accepted, which end() returns.
+ *
+ * The FA must outlive the StreamMatcher. Many StreamMatchers, on different
+ * threads, can share one FA, but each one belongs to a single thread.
+ */
+class StreamMatcher {
+
+public:
+
+  typedef std::function<void (size_t, size_t)> callback_type;
+
+  StreamMatcher(const FA&, const callback_type&);
+
+  StreamMatcher& feed(const char*, size_t);
+
+  bool end();
+
+  void reset();
+
+private:
+
+  struct Thread {
+
+    FA::state_type state;
+    size_t start;
+  };
+
+  void startThreads();
+  void checkFinal();
+  void stepThreads(const FA::symbol_type&);
+  void stepAnchored(const FA::symbol_type&);
+  void step(const FA::state_type&, const FA::symbol_type&,
+            std::vector<FA::state_type>&) const;
+
+  const FA& fa;
+  const callback_type onMatch;
+
+  /* The FA if it is a DFA, so that its table can be read directly instead of
+   * through FA::step.
+   */
+  const DFA* const dfa;
+
+  /* Stream offset of the next byte to be fed. */
+  size_t offset;
+
+  /* The states reached by the whole stream so far. */
+  std::vector<FA::state_type> anchored;
+
+  /* Search threads, in order of their start offsets. */
+  std::vector<Thread> threads;
+
+  /* No new threads start before this offset. */
+  size_t nextStart;
+
+  /* Scratch space, kept between calls so that once it has grown to fit the
+   * FA, feed() does not allocate. (An NFA steps with scratch sets of its own
+   * for each thread.)
+   */
+  std::vector<Thread> nextThreads;
+  std::vector<FA::state_type> stepped;
+  std::vector<char> seen;
+};
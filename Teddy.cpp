@@ -0,0 +1,238 @@
+#include "Teddy.h"
+
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TEDDY_X86
+#include <immintrin.h>
+#endif
+
+const size_t Teddy::MAX_LENGTH;
+const size_t Teddy::MAX_STRINGS;
+
+Teddy::Teddy() {
+
+  std::memset(&masks, 0, sizeof masks);
+}
+
+/**
+ * Builds the tables for a set of fingerprints.
+ *
+ * Fingerprints are sorted and the buckets given runs of them, so that each
+ * bucket holds similar strings and mixing them up admits fewer candidates.
+ *
+ * @param strings The fingerprints, which must all have the same length,
+ *                between 1 and MAX_LENGTH. There may be at most MAX_STRINGS.
+ */
+Teddy::Teddy(std::vector<std::string> strings) :
+  Teddy() {
+
+  if (strings.empty()) return;
+
+  std::sort(std::begin(strings), std::end(strings));
+
+  strings.erase(std::unique(std::begin(strings), std::end(strings)),
+                std::end(strings));
+
+  masks.length = strings.front().size();
+
+  for (size_t i = 0; i < strings.size(); ++i) {
+
+    const unsigned char bucket = 1 << (i * 8 / strings.size());
+
+    for (size_t j = 0; j < masks.length; ++j) {
+
+      const unsigned char c = strings[i][j];
+
+      masks.lo[j][c & 0xf]  |= bucket;
+      masks.hi[j][c >> 4]   |= bucket;
+      masks.exact[j][c]     |= bucket;
+    }
+  }
+}
+
+bool Teddy::empty() const {
+
+  return masks.length == 0;
+}
+
+/* Whether some bucket has every byte at p in place. */
+static bool check(const Teddy::Masks& masks, const char* p) {
+
+  unsigned char buckets = 0xff;
+
+  for (size_t j = 0; j < masks.length; ++j)
+
+    buckets &= masks.exact[j][static_cast<unsigned char>(p[j])];
+
+  return buckets != 0;
+}
+
+static const char* findScalar(const Teddy::Masks& masks,
+                              const char* first, const char* last) {
+
+  if (static_cast<size_t>(last - first) < masks.length) return last;
+
+  for (const char* end = last - masks.length + 1; first != end; ++first)
+
+    if (check(masks, first)) return first;
+
+  return last;
+}
+
+#ifdef TEDDY_X86
+
+/* Checks the candidates in a bit mask of offsets from p. */
+static const char* checkAll(const Teddy::Masks& masks, const char* p,
+                            unsigned candidates) {
+
+  for (; candidates; candidates &= candidates - 1) {
+
+    const char* candidate = p + __builtin_ctz(candidates);
+
+    if (check(masks, candidate)) return candidate;
+  }
+
+  return nullptr;
+}
+
+__attribute__((target("ssse3")))
+static const char* findSSSE3(const Teddy::Masks& masks,
+                             const char* first, const char* last) {
+
+  const size_t length = masks.length;
+
+  const __m128i nibble = _mm_set1_epi8(0xf);
+  const __m128i zero   = _mm_setzero_si128();
+
+  __m128i lo[Teddy::MAX_LENGTH], hi[Teddy::MAX_LENGTH];
+
+  for (size_t j = 0; j < length; ++j) {
+
+    lo[j] = _mm_load_si128(reinterpret_cast<const __m128i*>(masks.lo[j]));
+    hi[j] = _mm_load_si128(reinterpret_cast<const __m128i*>(masks.hi[j]));
+  }
+
+  /* Byte i of the result is for a fingerprint starting at p + i, so the
+   * loads reach length - 1 bytes past the block.
+   */
+  for (; static_cast<size_t>(last - first) >= 16 + length - 1; first += 16) {
+
+    __m128i buckets = _mm_set1_epi8(-1);
+
+    for (size_t j = 0; j < length; ++j) {
+
+      const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + j));
+
+      const __m128i l = _mm_shuffle_epi8(lo[j], _mm_and_si128(block, nibble));
+      const __m128i h = _mm_shuffle_epi8(hi[j],
+        _mm_and_si128(_mm_srli_epi16(block, 4), nibble));
+
+      buckets = _mm_and_si128(buckets, _mm_and_si128(l, h));
+    }
+
+    const unsigned candidates =
+      ~_mm_movemask_epi8(_mm_cmpeq_epi8(buckets, zero)) & 0xffff;
+
+    if (candidates) {
+
+      const char* found = checkAll(masks, first, candidates);
+
+      if (found) return found;
+    }
+  }
+
+  return findScalar(masks, first, last);
+}
+
+__attribute__((target("avx2")))
+static const char* findAVX2(const Teddy::Masks& masks,
+                            const char* first, const char* last) {
+
+  const size_t length = masks.length;
+
+  const __m256i nibble = _mm256_set1_epi8(0xf);
+  const __m256i zero   = _mm256_setzero_si256();
+
+  /* Shuffles work within each 16-byte lane, so both lanes get the tables. */
+  __m256i lo[Teddy::MAX_LENGTH], hi[Teddy::MAX_LENGTH];
+
+  for (size_t j = 0; j < length; ++j) {
+
+    lo[j] = _mm256_broadcastsi128_si256(
+      _mm_load_si128(reinterpret_cast<const __m128i*>(masks.lo[j])));
+    hi[j] = _mm256_broadcastsi128_si256(
+      _mm_load_si128(reinterpret_cast<const __m128i*>(masks.hi[j])));
+  }
+
+  for (; static_cast<size_t>(last - first) >= 32 + length - 1; first += 32) {
+
+    __m256i buckets = _mm256_set1_epi8(-1);
+
+    for (size_t j = 0; j < length; ++j) {
+
+      const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + j));
+
+      const __m256i l = _mm256_shuffle_epi8(lo[j],
+        _mm256_and_si256(block, nibble));
+      const __m256i h = _mm256_shuffle_epi8(hi[j],
+        _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+
+      buckets = _mm256_and_si256(buckets, _mm256_and_si256(l, h));
+    }
+
+    const unsigned candidates =
+      ~static_cast<unsigned>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(buckets, zero)));
+
+    if (candidates) {
+
+      const char* found = checkAll(masks, first, candidates);
+
+      if (found) return found;
+    }
+  }
+
+  return findSSSE3(masks, first, last);
+}
+
+#endif
+
+typedef const char* (*find_type)(const Teddy::Masks&, const char*, const char*);
+
+static find_type chooseFind() {
+
+#ifdef TEDDY_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+
+    return findAVX2;
+
+  if (__builtin_cpu_supports("ssse3"))
+
+    return findSSSE3;
+#endif
+
+  return findScalar;
+}
+
+/**
+ * Finds the first place in [first, last) where a fingerprint might start.
+ *
+ * @param  first The beginning of the input.
+ * @param  last  The end of the input.
+ * @return       The candidate, or last if there is none (or no fingerprints).
+ */
+const char* Teddy::find(const char* first, const char* last) const {
+
+  static const find_type findBest = chooseFind();
+
+  if (empty()) return last;
+
+  return findBest(masks, first, last);
+}
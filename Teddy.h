@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * Finds where any of a set of short strings might occur, many bytes at once.
+ *
+ * This is the "Teddy" algorithm. The strings (fingerprints) all have the same
+ * length, from 1 to 3, and are split into 8 buckets. For each position in a
+ * fingerprint there are two 16-entry tables, indexed by the low and high
+ * nibbles of an input byte, which give the buckets that could have that byte
+ * there. With SSSE3 or AVX2, one shuffle per table looks up 16 or 32 input
+ * bytes at a time; ANDing the results for every position leaves a bucket bit
+ * set only where some fingerprint of the bucket might start. Those candidates
+ * are checked against exact per-byte tables before they are returned, but a
+ * candidate can still mix bytes from different fingerprints of one bucket, so
+ * the caller has to verify it.
+ *
+ * The instruction set is chosen at run time, and plain C++ is used when
+ * neither is available.
+ */
+class Teddy {
+
+public:
+
+  static const size_t MAX_LENGTH  = 3;
+  static const size_t MAX_STRINGS = 64;
+
+  /* The lookup tables: a bit for each bucket. */
+  struct Masks {
+
+    alignas(16) unsigned char lo[MAX_LENGTH][16];
+    alignas(16) unsigned char hi[MAX_LENGTH][16];
+    unsigned char exact[MAX_LENGTH][256];
+    size_t length;
+  };
+
+  /* Finds nothing, ever. */
+  Teddy();
+
+  explicit Teddy(std::vector<std::string>);
+
+  bool empty() const;
+
+  const char* find(const char*, const char*) const;
+
+private:
+
+  Masks masks;
+};
@@ -0,0 +1,117 @@
+#include "ThompsonBuilder.h"
+
+/* Matches only the empty string. */
+ThompsonBuilder::Fragment ThompsonBuilder::empty() {
+
+  const FA::state_type q = newState();
+
+  return {q, q, false};
+}
+
+/* Matches any single symbol in a set. */
+ThompsonBuilder::Fragment ThompsonBuilder::symbols(
+  const FA::symbol_set_type& set) {
+
+  const FA::state_type start = newState();
+  const FA::state_type end   = newState();
+
+  faBuilder.transition(start, set, end);
+
+  return {start, end, false};
+}
+
+ThompsonBuilder::Fragment ThompsonBuilder::concatenate(const Fragment& frag1,
+                                                       const Fragment& frag2) {
+
+  faBuilder.transition(frag1.end, EPSILON, frag2.start);
+
+  return {frag1.start, frag2.end, false};
+}
+
+/* A chain of alternations shares one start and one end state, so that the
+ * EPSILON closure of the start is not repeated at every level of nesting.
+ */
+ThompsonBuilder::Fragment ThompsonBuilder::alternate(const Fragment& frag1,
+                                                     const Fragment& frag2) {
+
+  if (frag1.alternation || frag2.alternation) {
+
+    const Fragment& outer = frag1.alternation ? frag1 : frag2;
+    const Fragment& inner = frag1.alternation ? frag2 : frag1;
+
+    faBuilder.transition(outer.start, EPSILON, inner.start);
+    faBuilder.transition(inner.end, EPSILON, outer.end);
+
+    return outer;
+  }
+
+  const FA::state_type start = newState();
+  const FA::state_type end   = newState();
+
+  faBuilder.transition(start, EPSILON, frag1.start);
+  faBuilder.transition(start, EPSILON, frag2.start);
+  faBuilder.transition(frag1.end, EPSILON, end);
+  faBuilder.transition(frag2.end, EPSILON, end);
+
+  return {start, end, true};
+}
+
+ThompsonBuilder::Fragment ThompsonBuilder::repeat(const Fragment& frag) {
+
+  const FA::state_type start = newState();
+  const FA::state_type end   = newState();
+
+  faBuilder.transition(start, EPSILON, frag.start);
+  faBuilder.transition(start, EPSILON, end);
+  faBuilder.transition(frag.end, EPSILON, frag.start);
+  faBuilder.transition(frag.end, EPSILON, end);
+
+  return {start, end, false};
+}
+
+/* Like repeat, but frag must match at least once. */
+ThompsonBuilder::Fragment ThompsonBuilder::plus(const Fragment& frag) {
+
+  const FA::state_type start = newState();
+  const FA::state_type end   = newState();
+
+  faBuilder.transition(start, EPSILON, frag.start);
+  faBuilder.transition(frag.end, EPSILON, frag.start);
+  faBuilder.transition(frag.end, EPSILON, end);
+
+  return {start, end, false};
+}
+
+ThompsonBuilder::Fragment ThompsonBuilder::optional(const Fragment& frag) {
+
+  const FA::state_type start = newState();
+  const FA::state_type end   = newState();
+
+  faBuilder.transition(start, EPSILON, frag.start);
+  faBuilder.transition(start, EPSILON, end);
+  faBuilder.transition(frag.end, EPSILON, end);
+
+  return {start, end, false};
+}
+
+/**
+ * Builds an FA which accepts what frag matches.
+ *
+ * States which frag cannot reach are left out, so fragments which were built
+ * but never used cost nothing.
+ *
+ * @param  frag The fragment for the whole regex.
+ * @return      The FA.
+ */
+std::unique_ptr<FA> ThompsonBuilder::build(const Fragment& frag) {
+
+  return faBuilder
+    .initial_state(frag.start)
+    .final_state(frag.end)
+    .build();
+}
+
+FA::state_type ThompsonBuilder::newState() {
+
+  return state_count++;
+}
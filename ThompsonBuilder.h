@@ -0,0 +1,53 @@
+#pragma once
+
+#include "FA.h"
+#include "FABuilder.h"
+
+#include <memory>
+
+/**
+ * Builds an NFA from a regex one piece at a time, by Thompson's construction.
+ *
+ * Every piece is a Fragment: a start state and an end state within one shared
+ * FABuilder. Combining fragments only adds a few states and EPSILON
+ * transitions, and never copies them, so building the NFA for a regex takes
+ * time linear in its length. Nothing becomes an FA until build() is called.
+ */
+class ThompsonBuilder {
+
+public:
+
+  /* Fragments are meant to be used once: combining them may reuse their
+   * states.
+   */
+  struct Fragment {
+
+    FA::state_type start;
+    FA::state_type end;
+
+    /* Whether this came straight from alternate(), so that further
+     * alternatives can be added to its start and end states.
+     */
+    bool alternation;
+  };
+
+  ThompsonBuilder() = default;
+
+  Fragment empty();
+  Fragment symbols(const FA::symbol_set_type&);
+
+  Fragment concatenate(const Fragment&, const Fragment&);
+  Fragment alternate  (const Fragment&, const Fragment&);
+  Fragment repeat     (const Fragment&);
+  Fragment plus       (const Fragment&);
+  Fragment optional   (const Fragment&);
+
+  std::unique_ptr<FA> build(const Fragment&);
+
+private:
+
+  FA::state_type newState();
+
+  FABuilder faBuilder;
+  FA::state_type state_count = 0;
+};
@@ -0,0 +1,252 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <exception>
+
+const size_t ThreadPool::JOBS_PER_THREAD;
+
+/* One call to parallelFor, which lives on its caller's stack. */
+struct ThreadPool::Batch {
+
+  const task_type* task;
+
+  std::atomic<size_t> remaining;
+
+  std::mutex mutex;
+  std::condition_variable done;
+
+  /* The first exception a job threw, which parallelFor rethrows. */
+  std::exception_ptr error;
+};
+
+/**
+ * @param workers The number of threads to start. With none, parallelFor
+ *                runs everything on the calling thread.
+ */
+ThreadPool::ThreadPool(const size_t& workers) :
+  queued(0),
+  stopping(false) {
+
+  for (size_t i = 0; i < std::max<size_t>(workers, 1); ++i)
+
+    queues.emplace_back(new Queue());
+
+  for (size_t i = 0; i < workers; ++i)
+
+    threads.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    stopping = true;
+  }
+
+  wake.notify_all();
+
+  for (std::thread& thread : threads)
+
+    thread.join();
+}
+
+size_t ThreadPool::size() const {
+
+  return threads.size() + 1;
+}
+
+ThreadPool& ThreadPool::shared() {
+
+  static ThreadPool pool(
+    std::max<unsigned>(std::thread::hardware_concurrency(), 1) - 1);
+
+  return pool;
+}
+
+/**
+ * Calls task(first, last) for ranges which cover [0, n) exactly once, on the
+ * pool's threads and the caller's, and returns when they have all finished.
+ *
+ * @param n     The number of items.
+ * @param grain The fewest items worth handing to another thread.
+ * @param task  What to do with a range of items. If it throws, the rest of
+ *              the ranges are still run, and the first exception is rethrown
+ *              here.
+ */
+void ThreadPool::parallelFor(const size_t& n, const size_t& grain,
+                             const task_type& task) {
+
+  const size_t jobs = std::min((n + std::max<size_t>(grain, 1) - 1) /
+                                 std::max<size_t>(grain, 1),
+                               JOBS_PER_THREAD * size());
+
+  if (jobs <= 1 || threads.empty()) {
+
+    if (n) task(0, n);
+
+    return;
+  }
+
+  Batch batch;
+
+  batch.task = &task;
+  batch.remaining = jobs;
+
+  /* Deal the ranges out in order, so each worker starts on its own stretch
+   * of the input.
+   */
+  for (size_t j = 0; j < jobs; ++j) {
+
+    Queue& queue = *queues[j * queues.size() / jobs];
+
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    queue.jobs.push_back({&batch, j * n / jobs, (j + 1) * n / jobs});
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    queued += jobs;
+  }
+
+  wake.notify_all();
+
+  /* Help out until nothing of this loop is left to take. Only this loop's
+   * jobs are taken: a job of another loop might be the one this thread is
+   * in the middle of, e.g. holding a lock or a std::call_once.
+   */
+  Job job;
+
+  while (batch.remaining != 0 && take(queues.size(), job, &batch))
+
+    run(job);
+
+  std::unique_lock<std::mutex> lock(batch.mutex);
+
+  batch.done.wait(lock, [&batch] () { return batch.remaining == 0; });
+
+  if (batch.error)
+
+    std::rethrow_exception(batch.error);
+}
+
+void ThreadPool::work(const size_t& self) {
+
+  for (;;) {
+
+    Job job;
+
+    if (take(self, job, nullptr)) {
+
+      run(job);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    wake.wait(lock, [this] () { return stopping || queued > 0; });
+
+    if (stopping && queued <= 0)
+
+      return;
+  }
+}
+
+/**
+ * Takes a job from the back of queue self, or steals one from the front of
+ * another queue.
+ *
+ * @param  self  The taker's own queue, or queues.size() for a caller of
+ *               parallelFor, which only steals.
+ * @param  job   Receives the job.
+ * @param  batch If not null, only a job of this batch is taken.
+ * @return       Whether there was a job.
+ */
+bool ThreadPool::take(const size_t& self, Job& job, const Batch* batch) {
+
+  if (batch) {
+
+    for (size_t i = 0; i < queues.size(); ++i) {
+
+      Queue& queue = *queues[i];
+
+      std::lock_guard<std::mutex> lock(queue.mutex);
+
+      for (auto it = std::begin(queue.jobs); it != std::end(queue.jobs); ++it)
+
+        if (it->batch == batch) {
+
+          job = *it;
+          queue.jobs.erase(it);
+          --queued;
+
+          return true;
+        }
+    }
+
+    return false;
+  }
+
+  if (self < queues.size()) {
+
+    Queue& queue = *queues[self];
+
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (!queue.jobs.empty()) {
+
+      job = queue.jobs.back();
+      queue.jobs.pop_back();
+      --queued;
+
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i <= queues.size(); ++i) {
+
+    Queue& queue = *queues[(self + i) % queues.size()];
+
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (!queue.jobs.empty()) {
+
+      job = queue.jobs.front();
+      queue.jobs.pop_front();
+      --queued;
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::run(const Job& job) {
+
+  Batch& batch = *job.batch;
+
+  try {
+
+    (*batch.task)(job.first, job.last);
+  }
+  catch (...) {
+
+    std::lock_guard<std::mutex> lock(batch.mutex);
+
+    if (!batch.error)
+
+      batch.error = std::current_exception();
+  }
+
+  /* Counting down under the lock means the caller cannot see the batch
+   * finish, and destroy it, before this is done with it.
+   */
+  std::lock_guard<std::mutex> lock(batch.mutex);
+
+  if (--batch.remaining == 0)
+
+    batch.done.notify_all();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+/**
+ * A fixed set of worker threads which share out the pieces of a loop.
+ *
+ * parallelFor splits [0, n) into ranges and deals them out to a queue per
+ * worker. Each worker takes ranges from the back of its own queue, and when
+ * that is empty steals from the front of the others', so uneven work (long
+ * strings next to short ones) evens out without a central queue to fight
+ * over. The calling thread takes ranges of its own loop too until it is
+ * done, so a pool with no workers simply runs the loop itself.
+ *
+ * Any number of threads may call parallelFor at once, and a task may call
+ * parallelFor on the same pool.
+ */
+class ThreadPool {
+
+public:
+
+  typedef std::function<void (size_t, size_t)> task_type;
+
+  explicit ThreadPool(const size_t& workers);
+
+  ThreadPool(const ThreadPool&) = delete;
+
+  ThreadPool& operator = (const ThreadPool&) = delete;
+
+  ~ThreadPool();
+
+  void parallelFor(const size_t& n, const size_t& grain, const task_type&);
+
+  /* The number of threads a loop is spread over, counting the caller. */
+  size_t size() const;
+
+  /* A pool with a worker for every core but the caller's. */
+  static ThreadPool& shared();
+
+private:
+
+  struct Batch;
+
+  struct Job {
+
+    Batch* batch;
+    size_t first, last;
+  };
+
+  struct Queue {
+
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  void work(const size_t& self);
+  bool take(const size_t& self, Job&, const Batch*);
+  void run(const Job&);
+
+  /* Jobs per thread in a loop, so that there is something left to steal. */
+  static const size_t JOBS_PER_THREAD = 4;
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> threads;
+
+  /* Jobs which have been queued and not yet taken. It can dip below zero
+   * while a loop is being dealt out.
+   */
+  std::atomic<long> queued;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping;
+};
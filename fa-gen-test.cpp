@@ -0,0 +1,124 @@
+/**
+ * Checks the matchers fa-gen writes, in both styles, against FA::match.
+ *
+ *   fa-gen-test RULES
+ *
+ * Built by fa-gen-test.sh, which generates table.h and switch.h from RULES
+ * and lists the names in rules.list as RULE(name), one per line.
+ */
+#include "FA.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace table {
+
+#include "table.h"
+}
+
+namespace switched {
+
+#include "switch.h"
+}
+
+struct Rule {
+
+  const char* name;
+  bool (*table)(const std::string&);
+  bool (*switched)(const std::string&);
+};
+
+#define RULE(name) { #name, &table::name::match, &switched::name::match },
+
+static const Rule RULES[] = {
+
+#include "rules.list"
+};
+
+#undef RULE
+
+/* Every string up to length bytes long, over bytes that the rules give
+ * meaning to.
+ */
+static std::vector<std::string> allStrings(const size_t& length) {
+
+  static const std::string alphabet = "abc\xff\x80\"\\?/";
+
+  std::vector<std::string> strings(1);
+
+  for (size_t begin = 0, n = 0; n < length; ++n) {
+
+    const size_t end = strings.size();
+
+    for (size_t i = begin; i < end; ++i)
+
+      for (const char& c : alphabet)
+
+        strings.push_back(strings[i] + c);
+
+    begin = end;
+  }
+
+  return strings;
+}
+
+int main(int argc, char** argv) {
+
+  if (argc != 2) {
+
+    fprintf(stderr, "usage: %s RULES\n", argv[0]);
+    return 2;
+  }
+
+  std::ifstream in(argv[1]);
+  std::string line;
+
+  /* Each rule's regex, parsed as fa-gen does. */
+  std::map<std::string, std::string> regexes;
+
+  while (std::getline(in, line)) {
+
+    const size_t nameBegin = line.find_first_not_of(" \t");
+
+    if (nameBegin == std::string::npos || line[nameBegin] == '#') continue;
+
+    const size_t nameEnd    = line.find_first_of(" \t", nameBegin);
+    const size_t regexBegin = line.find_first_not_of(" \t", nameEnd);
+
+    regexes[line.substr(nameBegin, nameEnd - nameBegin)] =
+      line.substr(regexBegin);
+  }
+
+  const std::vector<std::string> strings = allStrings(4);
+  size_t failures = 0;
+
+  for (const Rule& rule : RULES) {
+
+    const std::unique_ptr<FA> fa = FA::fromRegex(regexes.at(rule.name));
+
+    for (const std::string& str : strings) {
+
+      const bool expected = fa->match(str.begin(), str.end());
+
+      if (rule.table(str) != expected || rule.switched(str) != expected) {
+
+        fprintf(stderr, "FAILED: %s on \"%s\": table %d, switch %d, FA %d\n",
+                rule.name, str.c_str(), rule.table(str), rule.switched(str),
+                expected);
+        ++failures;
+      }
+    }
+  }
+
+  if (failures) return 1;
+
+  printf("All %zu rules match FA::match.\n", sizeof RULES / sizeof *RULES);
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+#!/bin/sh
+#
+# Runs fa-gen on a small rules file in both styles, checks that each header
+# compiles on its own without warnings, then checks its matchers against
+# FA::match with fa-gen-test.cpp.
+#
+#   ./fa-gen-test.sh
+#
+# CXX and CXXFLAGS are used if set.
+
+set -e
+
+src=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--O2}
+flags="-std=c++11 -pthread -I$src -I$work"
+
+cd "$work"
+
+for file in "$src"/*.cpp; do
+
+  case $(basename "$file") in
+    fa-test.cpp|fa-gen.cpp|fa-gen-test.cpp) ;;
+    *) $CXX $flags $CXXFLAGS -c "$file" ;;
+  esac
+done
+
+$CXX $flags $CXXFLAGS -o fa-gen "$src/fa-gen.cpp" ./*.o
+
+# The rules use each byte quote() in fa-gen.cpp escapes in the comment above
+# a matcher (backslash, double quote, and ? for trigraphs like ??/) and high
+# bytes, which it writes in octal.
+cat > rules <<'EOF'
+# Rules for fa-gen-test.sh.
+backslash   a\\b*
+quote       "[^"]*"
+question    a\?b?
+trigraph    \??/
+line_end    ab\\
+empty       ()
+classes     [a-c]+[^ab]
+bounds      (ab|c){1,2}
+anything    .*
+EOF
+printf 'high        \377+\200?\n'    >> rules
+printf 'high_class  [a\377]*[^\200]\n' >> rules
+printf 'high_range  [\200-\377]a\n'  >> rules
+
+./fa-gen rules > table.h
+./fa-gen --switch rules > switch.h
+
+for header in table.h switch.h; do
+
+  echo "#include \"$header\"" > "$header.cpp"
+  $CXX $flags -Wall -Wextra -Werror -c -o /dev/null "$header.cpp"
+done
+
+sed -n 's/^\([A-Za-z_][A-Za-z0-9_]*\)[ \t].*/RULE(\1)/p' rules > rules.list
+
+$CXX $flags $CXXFLAGS -o fa-gen-test "$src/fa-gen-test.cpp" ./*.o
+
+./fa-gen-test rules
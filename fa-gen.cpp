@@ -0,0 +1,177 @@
+/**
+ * Compiles a file of regexes into a header of matchers, ahead of time.
+ *
+ *   fa-gen [--switch] RULES > HEADER
+ *
+ * Each line of RULES is a name, which must be a C++ identifier, then
+ * whitespace, then a regex which runs to the end of the line (write () for
+ * the empty regex). Blank lines and lines starting with '#' are skipped. The
+ * header gets one struct per regex, as written by CodeGenerator, using
+ * tables unless --switch is given.
+ * A build can regenerate the header whenever the rules change, e.g. with a
+ * make rule like
+ *
+ *   rules.h: rules.txt fa-gen
+ *   	./fa-gen rules.txt > rules.h
+
+ * fa-gen-test.sh runs fa-gen on a small rules file and checks the headers it
+ * writes against FA::match.
+ */
+#include "FA.h"
+#include "FAExcept.h"
+#include "CodeGenerator.h"
+
+#include <cstdio>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <map>
+
+static bool isIdentifier(const std::string& name) {
+
+  if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0])))
+
+    return false;
+
+  for (const char& c : name)
+
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') return false;
+
+  return true;
+}
+
+/* A regex as a string literal, so that no byte of it (a backslash at the end
+ * of the line, say) can change the meaning of the comment it goes in.
+ */
+static std::string quote(const std::string& regex) {
+
+  std::string quoted = "\"";
+
+  for (const char& c : regex) {
+
+    const unsigned char b = static_cast<unsigned char>(c);
+
+    if (c == '\\' || c == '"' || c == '?')
+
+      quoted += std::string("\\") + c;
+
+    else if (std::isprint(b))
+
+      quoted += c;
+
+    else {
+
+      char octal[5];
+
+      snprintf(octal, sizeof octal, "\\%03o", b);
+
+      quoted += octal;
+    }
+  }
+
+  return quoted + "\"";
+}
+
+int main(int argc, char** argv) {
+
+  CodeStyle style = CodeStyle::TABLE;
+  const char* path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+
+    if (std::string(argv[i]) == "--switch")
+
+      style = CodeStyle::SWITCH;
+
+    else
+
+      path = argv[i];
+  }
+
+  if (!path) {
+
+    fprintf(stderr, "usage: %s [--switch] RULES > HEADER\n", argv[0]);
+    return 2;
+  }
+
+  std::ifstream rules(path);
+
+  if (!rules) {
+
+    fprintf(stderr, "%s: cannot read %s\n", argv[0], path);
+    return 1;
+  }
+
+  std::ostringstream header;
+
+  header << "// Generated by fa-gen from " << path << ". Do not edit.\n\n"
+         << "#pragma once\n\n"
+         << "#include <cstddef>\n"
+         << "#include <cstdint>\n"
+         << "#include <string>\n";
+
+  std::string line;
+
+  /* The line each name was defined on. */
+  std::map<std::string, size_t> names;
+
+  for (size_t lineNumber = 1; std::getline(rules, line); ++lineNumber) {
+
+    const size_t nameBegin = line.find_first_not_of(" \t");
+
+    if (nameBegin == std::string::npos || line[nameBegin] == '#') continue;
+
+    const size_t nameEnd    = line.find_first_of(" \t", nameBegin);
+    const size_t regexBegin = line.find_first_not_of(" \t", nameEnd);
+
+    const std::string name = line.substr(nameBegin, nameEnd - nameBegin);
+
+    if (!isIdentifier(name)) {
+
+      fprintf(stderr, "%s:%zu: '%s' is not an identifier\n",
+              path, lineNumber, name.c_str());
+      return 1;
+    }
+
+    /* A name on its own is more likely a slip than the empty regex, which
+     * can be written as ().
+     */
+    if (regexBegin == std::string::npos) {
+
+      fprintf(stderr, "%s:%zu: '%s' has no regex\n",
+              path, lineNumber, name.c_str());
+      return 1;
+    }
+
+    const std::string regex = line.substr(regexBegin);
+
+    auto defined = names.emplace(name, lineNumber);
+
+    if (!defined.second) {
+
+      fprintf(stderr, "%s:%zu: '%s' was already defined on line %zu\n",
+              path, lineNumber, name.c_str(), defined.first->second);
+      return 1;
+    }
+
+    try {
+
+      const std::unique_ptr<FA> dfa = FA::normalize(FA::fromRegex(regex));
+
+      header << "\n// " << quote(regex) << "\n";
+
+      CodeGenerator::generate(*dfa, name, style, header);
+    } catch (const BadRegex&) {
+
+      fprintf(stderr, "%s:%zu: cannot parse \"%s\"\n",
+              path, lineNumber, regex.c_str());
+      return 1;
+    }
+  }
+
+  std::cout << header.str();
+
+  return 0;
+}
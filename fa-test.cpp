@@ -1,8 +1,909 @@
 #include "FA.h"
 #include "FABuilder.h"
+#include "ThreadPool.h"
+#include "StreamMatcher.h"
+#include "FAExcept.h"
+#include "RegexSet.h"
+#include "FAFormat.h"
+#include "MappedDFA.h"
+#include "Teddy.h"
+
+#if __cplusplus >= 201402L
+#include "StaticRegex.h"
+#endif
 
 #include <cstdio>
 #include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <iterator>
+#include <regex>
+#include <sstream>
+#include <algorithm>
+#include <fstream>
+
+static int failures = 0;
+
+/* Counts and reports a check which did not hold. */
+static void check(const bool& ok, const std::string& what) {
+
+  if (ok) return;
+
+  ++failures;
+
+  printf("FAILED: %s\n", what.c_str());
+}
+
+/* Literals and their sentinels must not mix up bytes above 0x7f. */
+static void testHighBitLiterals() {
+
+  const std::string input = "zz\xff" "bcd";
+
+  for (const Construction& construction : {Construction::THOMPSON,
+                                           Construction::GLUSHKOV}) {
+
+    const std::unique_ptr<FA> fa =
+      FA::fromRegex("x*[a\xff]bcd", construction);
+
+    const std::pair<const char*, const size_t> found =
+      fa->findNext(input.data(), input.size());
+
+    check(found.first == input.data() + 2 && found.second == 4,
+          "findNext of x*[a\\xff]bcd");
+  }
+
+  const std::unique_ptr<FA> dfa = FA::normalize(FA::fromRegex("(a|\xff)bcd"));
+
+  check(dfa->findNext(input.data() + 2, 4).second == 4,
+        "findNext of (a|\\xff)bcd");
+}
+
+/* A task may run a loop on its own pool, even inside a std::call_once which
+ * other tasks of the outer loop are waiting on.
+ */
+static void testNestedParallelFor() {
+
+  ThreadPool pool(4);
+
+  std::once_flag once;
+  std::atomic<size_t> inner(0), outer(0);
+
+  pool.parallelFor(64, 1, [&] (const size_t& first, const size_t& last) {
+
+    std::call_once(once, [&] () {
+
+      pool.parallelFor(1000, 1, [&] (const size_t& f, const size_t& l) {
+
+        inner += l - f;
+      });
+    });
+
+    outer += last - first;
+  });
+
+  check(inner == 1000 && outer == 64, "nested parallelFor");
+
+  /* Searching builds a DFA's search automata under a std::call_once, on
+   * ThreadPool::shared().
+   */
+  const std::unique_ptr<FA> dfa = FA::normalize(FA::fromRegex("(a|b)*abb"));
+  const std::string input = "ababbab";
+
+  std::atomic<size_t> found(0);
+
+  ThreadPool::shared().parallelFor(64, 1, [&] (const size_t& first,
+                                               const size_t& last) {
+
+    for (size_t i = first; i < last; ++i)
+
+      found += dfa->findNext(input.data(), input.size()).second == 5;
+  });
+
+  check(found == 64, "findNext inside ThreadPool::shared()");
+}
+
+/* Feeding an NFA a byte at a time finds what feeding it all at once does. */
+static void testStreamMatcher() {
+
+  const std::unique_ptr<FA> nfa =
+    FA::fromRegex("(a|b)*abb", Construction::THOMPSON);
+  const std::string input = "xxabbabbb";
+
+  std::vector<std::pair<size_t, size_t>> whole, bytes;
+
+  StreamMatcher matcher(*nfa, [&] (const size_t& offset, const size_t& length) {
+
+    whole.emplace_back(offset, length);
+  });
+
+  matcher.feed(input.data(), input.size());
+
+  check(!matcher.end(), "StreamMatcher::end");
+
+  StreamMatcher byByte(*nfa, [&] (const size_t& offset, const size_t& length) {
+
+    bytes.emplace_back(offset, length);
+  });
+
+  for (const char& c : input)
+
+    byByte.feed(&c, 1);
+
+  check(whole.size() == 2 && whole[0] == std::make_pair<size_t, size_t>(2, 3) &&
+        whole[1] == std::make_pair<size_t, size_t>(5, 3) && bytes == whole,
+        "StreamMatcher matches");
+
+  const std::unique_ptr<FA> dfa =
+    FA::normalize(FA::fromRegex("(a|b)*abb", Construction::THOMPSON));
+
+  std::vector<std::pair<size_t, size_t>> stepped;
+
+  StreamMatcher byTable(*dfa, [&] (const size_t& offset, const size_t& length) {
+
+    stepped.emplace_back(offset, length);
+  });
+
+  byTable.feed(input.data(), input.size());
+
+  check(stepped == whole, "StreamMatcher matches with a DFA");
+
+  /* The match which ends first, not the one which starts first. */
+  const std::unique_ptr<FA> first = FA::normalize(FA::fromRegex("abcd|c"));
+  const std::string abcd = "abcd";
+
+  std::vector<std::pair<size_t, size_t>> ends;
+
+  StreamMatcher(*first, [&] (const size_t& offset, const size_t& length) {
+
+    ends.emplace_back(offset, length);
+  }).feed(abcd.data(), abcd.size());
+
+  check(ends.size() == 1 && ends[0] == std::make_pair<size_t, size_t>(2, 1),
+        "StreamMatcher reports the match which ends first");
+}
+
+/* Threads share a LazyDFA's cache, including while it is being flushed. */
+static void testLazyMatchBatch() {
+
+  const std::string regex = "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)";
+
+  std::mt19937 random(17);
+  std::vector<std::string> strings(2000);
+
+  for (std::string& str : strings)
+
+    for (size_t n = random() % 200; n; --n)
+
+      str += "ab"[random() % 2];
+
+  const std::unique_ptr<FA> nfa = FA::fromRegex(regex, Construction::THOMPSON);
+
+  std::vector<bool> expected;
+
+  for (const std::string& str : strings)
+
+    expected.push_back(nfa->match(std::begin(str), std::end(str)));
+
+  ThreadPool pool(4);
+
+  /* A big cache, one which keeps being flushed, and one too small to use. */
+  for (const size_t cacheBytes : {1 << 20, 1 << 12, 0}) {
+
+    const std::unique_ptr<FA> lazy =
+      FA::lazy(FA::fromRegex(regex, Construction::THOMPSON), cacheBytes);
+
+    for (int round = 0; round < 3; ++round)
+
+      check(lazy->matchBatch(strings, pool) == expected,
+            "LazyDFA::matchBatch with a " + std::to_string(cacheBytes) +
+            " byte cache");
+  }
+}
+
+/* findAll's iterators work with the standard algorithms. */
+static void testFindAll() {
+
+  const std::string input = "aaa baa";
+
+  for (const Construction& construction : {Construction::THOMPSON,
+                                           Construction::GLUSHKOV}) {
+
+    const std::unique_ptr<FA> nfa = FA::fromRegex("a+", construction);
+    const std::unique_ptr<FA> dfa = FA::normalize(FA::fromRegex("a+",
+                                                                construction));
+
+    for (const FA* fa : {nfa.get(), dfa.get()}) {
+
+      auto shortest = fa->findAll(std::begin(input), std::end(input),
+                                  MatchSemantics::LEFTMOST_SHORTEST);
+      auto longest  = fa->findAll(std::begin(input), std::end(input),
+                                  MatchSemantics::LEFTMOST_LONGEST);
+
+      check(std::distance(std::begin(shortest), std::end(shortest)) == 5,
+            "findAll of a+, shortest");
+
+      const std::vector<std::pair<std::string::const_iterator,
+                                  std::string::const_iterator>>
+        matches(std::begin(longest), std::end(longest));
+
+      check(matches.size() == 2 &&
+            std::string(matches[1].first, matches[1].second) == "aa",
+            "findAll of a+, longest");
+    }
+  }
+}
+
+/* Whether fromRegex rejects a regex. */
+static bool rejects(const std::string& regex) {
+
+  try {
+
+    FA::fromRegex(regex);
+  } catch (const BadRegex&) {
+
+    return true;
+  }
+
+  return false;
+}
+
+/* A '{' which does not start bounds is a symbol, however big the number after
+ * it, and bounds are limited by the symbols they copy in all.
+ */
+static void testBounds() {
+
+  const std::unique_ptr<FA> brace = FA::fromRegex("a{99999999999x");
+  const std::string literal = "a{99999999999x";
+
+  check(brace->match(std::begin(literal), std::end(literal)),
+        "a{99999999999x as symbols");
+
+  const std::unique_ptr<FA> bounded = FA::fromRegex("(ab){2,3}");
+
+  for (const std::string str : {"", "ab", "abab", "ababab", "abababab"})
+
+    check(bounded->match(std::begin(str), std::end(str)) ==
+            (str.size() == 4 || str.size() == 6),
+          "(ab){2,3} on '" + str + "'");
+
+  check(!rejects("a{5000}"), "a{5000}");
+  check(rejects("a{99999999999}"), "a{99999999999}");
+  check(rejects("a{3,2}"), "a{3,2}");
+  check(rejects("((a{1000}){1000}){1000}"), "((a{1000}){1000}){1000}");
+  check(rejects("((){1000}){1000}"), "((){1000}){1000}");
+}
+
+/* A RegexSet matches what its regexes match one at a time. */
+static void testRegexSet() {
+
+  const std::vector<std::string> regexes = {"(a|b)*abb", "a+", "[ab]{2}", ""};
+  const std::vector<std::string> strings = {"", "a", "ab", "abb", "ba", "aa"};
+
+  for (const Construction& construction : {Construction::THOMPSON,
+                                           Construction::GLUSHKOV}) {
+
+    const RegexSet set(regexes, construction);
+
+    std::vector<bool> matched;
+
+    for (const std::string& str : strings) {
+
+      set.match(std::begin(str), std::end(str), matched);
+
+      check(matched == set.match(str.data(), str.size()) &&
+            matched.size() == regexes.size(), "RegexSet::match");
+
+      for (size_t i = 0; i < regexes.size(); ++i)
+
+        check(matched[i] == FA::fromRegex(regexes[i])->match(std::begin(str),
+                                                             std::end(str)),
+              "RegexSet with " + regexes[i] + " on '" + str + "'");
+    }
+  }
+}
+
+/* A random regex over a, b and c, in the syntax fromRegex and std::regex
+ * share. Quantifiers only follow a symbol or a group.
+ */
+static std::string randomRegex(std::mt19937& random, const int& depth) {
+
+  static const char* atoms[] = {"a", "b", "c", ".", "[ab]", "[^a]", "()"};
+  static const char* quantifiers[] = {"*", "+", "?", "{2}", "{0,2}", "{1,}"};
+
+  const std::string atom = atoms[random() % 7];
+
+  switch (depth == 0 ? 0 : random() % 5) {
+
+  case 0 :
+    return atom;
+
+  case 1 :
+    return atom + quantifiers[random() % 6];
+
+  case 2 :
+    return "(" + randomRegex(random, depth - 1) + ")" +
+           quantifiers[random() % 6];
+
+  case 3 :
+    return randomRegex(random, depth - 1) + randomRegex(random, depth - 1);
+
+  default :
+    return randomRegex(random, depth - 1) + "|" +
+           randomRegex(random, depth - 1);
+  }
+}
+
+/* Every string over a, b and c of up to length symbols. */
+static std::vector<std::string> allStrings(const size_t& length) {
+
+  std::vector<std::string> strings(1);
+
+  for (size_t i = 0; strings[i].size() < length; ++i)
+
+    for (const char& c : {'a', 'b', 'c'})
+
+      strings.push_back(strings[i] + c);
+
+  return strings;
+}
+
+/* Checks an FA against std::regex on every string, and reports the first
+ * string they disagree on.
+ */
+static void checkAgainst(const std::regex& expected, const FA& fa,
+                         const std::vector<std::string>& strings,
+                         const std::string& what) {
+
+  for (const std::string& str : strings)
+
+    if (fa.match(str.data(), str.size()) != std::regex_match(str, expected)) {
+
+      check(false, what + " on '" + str + "'");
+      return;
+    }
+}
+
+/* Both constructions, simulated by the Pike VM, accept what std::regex
+ * does.
+ */
+static void testPikeVM() {
+
+  std::mt19937 random(5);
+
+  const std::vector<std::string> strings = allStrings(5);
+
+  for (int i = 0; i < 200; ++i) {
+
+    const std::string regex = randomRegex(random, 3);
+    const std::regex expected(regex, std::regex::ECMAScript);
+
+    checkAgainst(expected, *FA::fromRegex(regex, Construction::THOMPSON),
+                 strings, "Thompson NFA for " + regex);
+    checkAgainst(expected, *FA::fromRegex(regex, Construction::GLUSHKOV),
+                 strings, "Glushkov NFA for " + regex);
+  }
+}
+
+/* The number of states in an FA, as save records it. */
+static size_t stateCount(const FA& fa) {
+
+  std::ostringstream out;
+
+  fa.save(out);
+
+  const std::string saved = out.str();
+
+  return FAFormat::readHeader(saved.data(), saved.size()).state_count;
+}
+
+/* Minimized DFAs accept what std::regex does, and are as small as can be:
+ * the same size from either construction, and no smaller the second time.
+ */
+static void testMinimize() {
+
+  std::mt19937 random(8);
+
+  const std::vector<std::string> strings = allStrings(5);
+
+  for (int i = 0; i < 200; ++i) {
+
+    const std::string regex = randomRegex(random, 3);
+
+    const std::unique_ptr<FA> thompson =
+      FA::normalize(FA::fromRegex(regex, Construction::THOMPSON));
+    const std::unique_ptr<FA> glushkov =
+      FA::normalize(FA::fromRegex(regex, Construction::GLUSHKOV));
+
+    checkAgainst(std::regex(regex, std::regex::ECMAScript), *thompson,
+                 strings, "minimized DFA for " + regex);
+
+    const size_t states = stateCount(*thompson);
+
+    check(stateCount(*glushkov) == states &&
+          stateCount(*FA::normalize(FA::normalize(
+            FA::fromRegex(regex)))) == states,
+          "minimal DFA for " + regex);
+  }
+
+  /* The k-th symbol from the end needs 2^k states. */
+  for (size_t k = 1; k <= 8; ++k) {
+
+    std::string regex = "(a|b)*a";
+
+    for (size_t i = 1; i < k; ++i)
+
+      regex += "(a|b)";
+
+    check(stateCount(*FA::normalize(FA::fromRegex(regex))) == size_t(1) << k,
+          "states of the minimal DFA for " + regex);
+  }
+}
+
+/* Postfix operators bind tightest, then concatenation, then '|', and bad
+ * regexes are rejected, however deeply they nest.
+ */
+static void testParser() {
+
+  const std::vector<std::pair<std::string, std::string>> same = {
+
+    {"ab|c",     "(ab)|c"},
+    {"ab*",      "a(b*)"},
+    {"a|b*c",    "a|((b*)c)"},
+    {"a|b|c",    "(a|b)|c"},
+    {"abc+",     "ab(c+)"},
+    {"ab{2}",    "a(b{2})"},
+    {"a|",       "a|()"},
+    {"|a",       "()|a"},
+    {"(a|)b?",   "(a|())(b?)"},
+    {"[a-c]b|.", "(([abc])b)|."}
+  };
+
+  const std::vector<std::string> strings = allStrings(4);
+
+  for (const std::pair<std::string, std::string>& pair : same) {
+
+    const std::unique_ptr<FA> fa = FA::fromRegex(pair.first);
+    const std::unique_ptr<FA> grouped = FA::fromRegex(pair.second);
+
+    for (const std::string& str : strings)
+
+      check(fa->match(std::begin(str), std::end(str)) ==
+              grouped->match(std::begin(str), std::end(str)),
+            pair.first + " as " + pair.second + " on '" + str + "'");
+  }
+
+  for (const std::string regex : {"(", ")", "(a", "a)", "*a", "a|*", "[",
+                                   "[b-a]", "a\\", "{2}", "(+)"})
+
+    check(rejects(regex), "rejecting " + regex);
+
+  const size_t depth = 100000;
+
+  const std::string nested = std::string(depth, '(') + "a" +
+                             std::string(depth, ')');
+
+  check(FA::fromRegex(nested)->match("a", 1), "deeply nested regex");
+  check(rejects(nested + ")"), "rejecting an unbalanced nested regex");
+}
+
+/* Teddy never skips a fingerprint, whatever the alignment and length of the
+ * input, and only stops where every byte could be part of one.
+ */
+static void testTeddy() {
+
+  std::mt19937 random(18);
+
+  /* Bytes which share nibbles, so that the shuffles admit false candidates. */
+  const std::string bytes = "abcqrs\x81\x91\xe1";
+
+  std::vector<char> buffer(300);
+
+  for (int round = 0; round < 300; ++round) {
+
+    const size_t length = 1 + random() % Teddy::MAX_LENGTH;
+
+    std::vector<std::string> strings(1 + random() % 20);
+
+    for (std::string& str : strings)
+
+      for (size_t i = 0; i < length; ++i)
+
+        str += bytes[random() % bytes.size()];
+
+    const Teddy teddy(strings);
+
+    for (char& c : buffer)
+
+      c = bytes[random() % bytes.size()];
+
+    const char* first = buffer.data() + random() % 32;
+    const char* last  = first + random() % (buffer.size() - 32);
+
+    const char* found = teddy.find(first, last);
+
+    const char* expected = last;
+
+    for (const char* p = first; p + length <= last && expected == last; ++p)
+
+      for (const std::string& str : strings)
+
+        if (std::equal(std::begin(str), std::end(str), p))
+
+          expected = p;
+
+    bool possible = found == last || found + length <= last;
+
+    for (size_t j = 0; possible && found != last && j < length; ++j)
+
+      possible = std::any_of(std::begin(strings), std::end(strings),
+                             [&] (const std::string& str) -> bool {
+
+                               return str[j] == found[j];
+                             });
+
+    check(found <= expected && possible, "Teddy::find");
+  }
+}
+
+/* The leftmost match from from on, shortest or longest, found by trying every
+ * start.
+ */
+static std::pair<size_t, size_t> findByHand(const FA& dfa,
+                                            const std::string& text,
+                                            const size_t& from = 0,
+                                            const MatchSemantics& semantics =
+                                              MatchSemantics::LEFTMOST_LONGEST) {
+
+  for (size_t i = from; i < text.size(); ++i) {
+
+    size_t length = 0;
+    bool found = false;
+
+    for (size_t n = 0; i + n <= text.size(); ++n) {
+
+      const MatchStatus status = dfa.matchStatus(text.data() + i, n);
+
+      if (status == MatchStatus::DEAD_STATE) break;
+
+      if (status == MatchStatus::MATCH) {
+
+        found = true;
+        length = n;
+
+        if (semantics == MatchSemantics::LEFTMOST_SHORTEST) break;
+      }
+    }
+
+    if (found) return {i, length};
+  }
+
+  return {text.size(), 0};
+}
+
+/* Searches which skip ahead with the literal or the prefixes find what
+ * trying every start does.
+ */
+static void testPrefilteredSearch() {
+
+  std::mt19937 random(180);
+
+  const std::string bytes = "abforzxy01ER ";
+
+  for (const std::string regex : {"(foo|bar|baz)[a-z]*z", "[xy][0-9]+",
+                                   "(ab|ro|ze)(o|z)", "[a-z]*ERR",
+                                   "b(a|r)+z"}) {
+
+    const std::unique_ptr<FA> nfa = FA::fromRegex(regex);
+    const std::unique_ptr<FA> dfa = FA::normalize(FA::fromRegex(regex));
+
+    for (int round = 0; round < 50; ++round) {
+
+      std::string text;
+
+      for (size_t n = random() % 300; n; --n)
+
+        text += bytes[random() % bytes.size()];
+
+      const std::pair<size_t, size_t> expected = findByHand(*dfa, text);
+
+      for (const FA* fa : {nfa.get(), dfa.get()}) {
+
+        const std::pair<const char*, const size_t> found =
+          fa->findNext(text.data(), text.size());
+
+        check(static_cast<size_t>(found.first - text.data()) ==
+                expected.first && found.second == expected.second,
+              "findNext of " + regex + " in '" + text + "'");
+      }
+    }
+  }
+}
+
+/* findAll finds, in either semantics, what trying every start after the last
+ * match does, in an NFA, a DFA and a LazyDFA. The last regex needs more than
+ * 10000 search states, one for each set of the last 14 bytes which were a, so
+ * the DFA searches with its threads instead.
+ */
+static void testFindAllByHand() {
+
+  std::mt19937 random(190);
+
+  std::vector<std::string> regexes;
+
+  for (int i = 0; i < 40; ++i)
+
+    regexes.push_back(randomRegex(random, 3));
+
+  regexes.push_back("a[ab]{13}");
+
+  for (const std::string& regex : regexes) {
+
+    const std::unique_ptr<FA> nfa  = FA::fromRegex(regex);
+    const std::unique_ptr<FA> dfa  = FA::normalize(FA::fromRegex(regex));
+    const std::unique_ptr<FA> lazy = FA::lazy(FA::fromRegex(regex), 1 << 16);
+
+    for (int round = 0; round < 20; ++round) {
+
+      std::string text;
+
+      for (size_t n = random() % 40; n; --n)
+
+        text += "abc"[random() % 3];
+
+      for (const MatchSemantics semantics : {MatchSemantics::LEFTMOST_SHORTEST,
+                                             MatchSemantics::LEFTMOST_LONGEST}) {
+
+        std::vector<std::pair<size_t, size_t>> expected;
+
+        for (size_t from = 0; ; ) {
+
+          const std::pair<size_t, size_t> match =
+            findByHand(*dfa, text, from, semantics);
+
+          if (match.first == text.size()) break;
+
+          expected.push_back(match);
+          from = match.first + std::max<size_t>(match.second, 1);
+        }
+
+        for (const FA* fa : {nfa.get(), dfa.get(), lazy.get()}) {
+
+          std::vector<std::pair<size_t, size_t>> found;
+
+          for (const auto& match : fa->findAll(std::begin(text), std::end(text),
+                                               semantics))
+
+            found.emplace_back(match.first - std::begin(text),
+                               match.second - match.first);
+
+          check(found == expected,
+                "findAll of " + regex + " in '" + text + "', " +
+                (semantics == MatchSemantics::LEFTMOST_SHORTEST ? "shortest" :
+                                                                  "longest"));
+        }
+      }
+    }
+  }
+}
+
+/* The bytes save writes for an FA. */
+static std::string saved(const FA& fa) {
+
+  std::ostringstream out;
+
+  fa.save(out);
+
+  return out.str();
+}
+
+/* Loaded and mapped automata accept what the ones saved did, and saving a
+ * loaded one gives the same bytes again.
+ */
+static void testSaveLoad() {
+
+  std::mt19937 random(20);
+
+  const std::vector<std::string> strings = allStrings(5);
+  const std::string path = "fa-test.fa";
+
+  for (int i = 0; i < 100; ++i) {
+
+    const std::string regex = randomRegex(random, 3);
+    const std::regex expected(regex, std::regex::ECMAScript);
+
+    const std::unique_ptr<FA> nfa = FA::fromRegex(regex);
+    const std::unique_ptr<FA> dfa = FA::normalize(FA::fromRegex(regex));
+
+    for (const FA* fa : {nfa.get(), dfa.get()}) {
+
+      const std::string bytes = saved(*fa);
+      const std::unique_ptr<FA> loaded = FA::load(bytes.data(), bytes.size());
+
+      checkAgainst(expected, *loaded, strings, "loaded FA for " + regex);
+      check(saved(*loaded) == bytes, "saving a loaded FA for " + regex);
+    }
+
+    {
+      std::ofstream file(path, std::ios::binary);
+
+      dfa->save(file);
+    }
+
+    const MappedDFA mapped(path);
+
+    for (const std::string& str : strings)
+
+      if (mapped.match(str.data(), str.size()) !=
+            std::regex_match(str, expected)) {
+
+        check(false, "mapped DFA for " + regex + " on '" + str + "'");
+        break;
+      }
+  }
+
+  std::remove(path.c_str());
+
+  const std::string bytes = saved(*FA::normalize(FA::fromRegex("(a|b)*abb")));
+
+  for (size_t n = 0; n < bytes.size(); n += 7) {
+
+    bool rejected = false;
+
+    try {
+
+      FA::load(bytes.data(), n);
+    } catch (const BadFormat&) {
+
+      rejected = true;
+    }
+
+    check(rejected, "loading " + std::to_string(n) + " bytes of a DFA");
+  }
+}
+
+/* Splitting a long input among threads gives the status one thread does,
+ * whether the chunks' start states are enumerated or guessed.
+ */
+static void testMatchParallel() {
+
+  std::mt19937 random(24);
+
+  std::string input(5 << 20, 'a');
+
+  for (char& c : input)
+
+    c = "ab"[random() % 2];
+
+  std::string dead = input;
+
+  dead[dead.size() / 2] = 'c';
+
+  ThreadPool pool(4);
+
+  for (const std::string regex : {"(a|b)*abb", "[ab]*",
+                                   "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)"}) {
+
+    const std::unique_ptr<FA> dfa = FA::normalize(FA::fromRegex(regex));
+
+    for (const std::string end : {"", "abb", "aaaaaaa", "bbbbbbb"})
+
+      for (const std::string* str : {&input, &dead}) {
+
+        const std::string text = *str + end;
+
+        check(dfa->matchStatusParallel(text.data(), text.size(), pool) ==
+                dfa->matchStatus(text.data(), text.size()),
+              "matchStatusParallel of " + regex);
+      }
+  }
+}
+
+/* Determinizing on several threads, including from inside a loop on the
+ * same pool, gives the DFA one thread does.
+ */
+static void testDeterminize() {
+
+  /* Over 1024 subsets are first reached on some levels, so the shards are
+   * filled in parallel too.
+   */
+  std::string regex = "(a|b)*a";
+
+  for (int i = 0; i < 11; ++i)
+
+    regex += "(a|b)";
+
+  ThreadPool none(0), pool(4);
+
+  const std::string expected =
+    saved(*FA::normalize(FA::fromRegex(regex), none));
+
+  check(saved(*FA::normalize(FA::fromRegex(regex), pool)) == expected,
+        "determinizing " + regex + " on a pool");
+
+  std::vector<std::string> results(8);
+
+  pool.parallelFor(results.size(), 1, [&] (const size_t& first,
+                                           const size_t& last) {
+
+    for (size_t i = first; i < last; ++i)
+
+      results[i] = saved(*FA::normalize(FA::fromRegex(regex), pool));
+  });
+
+  for (const std::string& result : results)
+
+    check(result == expected, "determinizing " + regex + " inside a loop");
+
+  check(stateCount(*FA::normalize(FA::fromRegex(regex), pool)) == 1 << 12,
+        "states of the DFA for " + regex);
+
+  std::mt19937 random(25);
+
+  const std::vector<std::string> strings = allStrings(5);
+
+  for (int i = 0; i < 100; ++i) {
+
+    const std::string other = randomRegex(random, 3);
+
+    checkAgainst(std::regex(other, std::regex::ECMAScript),
+                 *FA::normalize(FA::fromRegex(other), pool), strings,
+                 "DFA determinized on a pool for " + other);
+  }
+}
+
+#if __cplusplus >= 201402L
+
+/* Patterns which StaticRegex compiles while fa-test is compiled. */
+struct Alternatives { static constexpr const char* regex = "(a|b)*abb|c"; };
+struct EmptyOperands { static constexpr const char* regex = "(|a)(b|)|()"; };
+struct Classes { static constexpr const char* regex = "[ab]+[^a]?.c"; };
+struct Bounds { static constexpr const char* regex = "(ab|c){1,3}a{2,}"; };
+struct Optional { static constexpr const char* regex = "a?(b?c)*[a-b]{0,2}"; };
+struct Brace { static constexpr const char* regex = "a{2|b{,}c"; };
+struct Escapes { static constexpr const char* regex = "\\*a\\|b|[\\]c]+"; };
+
+/* A StaticRegex matches what fromRegex's FA for the same regex does. */
+template <typename Pattern>
+static void checkStatic(const std::vector<std::string>& strings) {
+
+  const std::unique_ptr<FA> fa = FA::fromRegex(Pattern::regex);
+
+  for (const std::string& str : strings) {
+
+    const bool expected = fa->match(std::begin(str), std::end(str));
+
+    if (StaticRegex<Pattern>::match(str.data(), str.size()) != expected ||
+        StaticRegex<Pattern>::match(std::begin(str), std::end(str)) !=
+          expected) {
+
+      check(false, std::string("StaticRegex of ") + Pattern::regex +
+                   " on '" + str + "'");
+      return;
+    }
+  }
+}
+
+static void testStaticRegex() {
+
+  std::vector<std::string> strings = allStrings(5);
+
+  for (const std::string str : {"a{2", "a{2c", "b{,}c", "*a|b", "]c]",
+                                 "*a\\|b"})
+
+    strings.push_back(str);
+
+  checkStatic<Alternatives>(strings);
+  checkStatic<EmptyOperands>(strings);
+  checkStatic<Classes>(strings);
+  checkStatic<Bounds>(strings);
+  checkStatic<Optional>(strings);
+  checkStatic<Brace>(strings);
+  checkStatic<Escapes>(strings);
+}
+
+#endif
 
 int main() {
 
@@ -17,11 +918,34 @@ int main() {
     "abababb"
   }) {
 
-    printf((fa->match(&*std::begin(str), &*std::end(str)) ? 
-      "'%s' matches!\n" : 
+    printf((fa->match(std::begin(str), std::end(str)) ?
+      "'%s' matches!\n" :
       "'%s' doesn't match.\n"
       ), str.c_str());
   }
 
-  return 0;
+  testHighBitLiterals();
+  testNestedParallelFor();
+  testStreamMatcher();
+  testLazyMatchBatch();
+  testFindAll();
+  testBounds();
+  testRegexSet();
+  testPikeVM();
+  testMinimize();
+  testParser();
+  testTeddy();
+  testPrefilteredSearch();
+  testFindAllByHand();
+  testSaveLoad();
+  testMatchParallel();
+  testDeterminize();
+
+#if __cplusplus >= 201402L
+  testStaticRegex();
+#endif
+
+  printf(failures ? "%d checks failed.\n" : "All checks passed.\n", failures);
+
+  return failures ? 1 : 0;
 }
@@ -1,266 +1,653 @@
 #include "FA.h"
 
-#include "FABuilder.h"
 #include "FAExcept.h"
+#include "ThompsonBuilder.h"
+#include "GlushkovBuilder.h"
 
 #include <memory>
 #include <string>
 #include <vector>
-
-#ifdef DEBUG
-#include <cstdio>
-#endif  // DEBUG
+#include <utility>
+#include <algorithm>
 
 enum class TokenType {
 
-  CHAR,
+  SYMBOLS,
   STAR,
+  PLUS,
+  QUESTION,
+  BOUNDS,
   V_BAR,
   L_PAREN,
-  R_PAREN,
-  EXPR
+  R_PAREN
 };
 
+/* symbols indexes the lexer's symbol sets, for SYMBOLS. min and max are the
+ * bounds of a BOUNDS token.
+ */
 struct Token {
 
-  Token(const TokenType& type, const std::string& value) :
-    type(type),
-    value(value) {}
-
-  Token(const Token& cToken) :
-    type(cToken.type),
-    value(cToken.value) {}
+  TokenType type;
+  size_t symbols;
+  unsigned min, max;
+};
 
-  Token(Token&& mToken) :
-    type(mToken.type),
-    value(mToken.value) {}
+enum class NodeType {
 
-  Token& operator = (Token&& mToken) {
+  EMPTY,
+  SYMBOLS,
+  CONCATENATE,
+  ALTERNATE,
+  REPEAT,
+  PLUS,
+  OPTIONAL,
+  BOUNDED
+};
 
-    std::swap(*this, mToken);
+/* What the parser has on its operator stack. */
+enum class Operator {
 
-    return *this;
-  }
+  CONCATENATE,
+  ALTERNATE,
+  GROUP         // An open parenthesis.
+};
 
-  const TokenType type;
-  const std::string value;
+/* A node of the syntax tree. The tree is kept as a vector in postfix order,
+ * so the operands of a node are the nodes completed just before it, and the
+ * tree can be evaluated left to right with a stack.
+ *
+ * For SYMBOLS, arg indexes the symbol sets. For BOUNDED, arg is where its
+ * operand's nodes begin, so that they can be evaluated again for every copy
+ * the bounds call for.
+ */
+struct Node {
+
+  NodeType type;
+  size_t arg;
+  unsigned min, max;
 };
 
-typename std::vector<Token>::iterator stackTopMatch(
-  std::vector<Token>& tokenStack,
-  const TokenType& type) {
+/* {m,} has no upper bound. */
+const unsigned UNBOUNDED = static_cast<unsigned>(-1);
 
-  if (tokenStack.size() == 0)
+/* Regexes whose bounds would copy more symbols than this in all are
+ * rejected, since every copy costs states.
+ */
+const size_t MAX_POSITIONS = 100000;
 
-    return std::end(tokenStack);
+/* Reads a decimal number at it, if there is one. A number too big for an
+ * unsigned is read as the biggest bound there is.
+ */
+static bool lexNumber(std::string::const_iterator& it,
+                      const std::string::const_iterator& last,
+                      unsigned& n) {
 
-  auto it = --std::end(tokenStack);
+  if (it == last || *it < '0' || *it > '9')
 
-  if (it->type == type)
+    return false;
 
-    return it;
-  else
+  const unsigned largest = UNBOUNDED - 1;
 
-    return std::end(tokenStack);
+  for (n = 0; it != last && *it >= '0' && *it <= '9'; ++it)
+
+    n = n > (largest - (*it - '0')) / 10 ? largest : 10 * n + (*it - '0');
+
+  return true;
 }
 
-template <typename... Args>
-typename std::vector<Token>::iterator stackTopMatch(
-  std::vector<Token>& tokenStack,
-  const TokenType& type,
-  Args... args) {
+/**
+ * Reads the bounds of a {m}, {m,} or {m,n}, with it just past the '{'.
+ *
+ * @return Whether there were bounds. If not, the '{' is an ordinary symbol
+ *         and it is left where it was.
+ */
+static bool lexBounds(std::string::const_iterator& it,
+                      const std::string::const_iterator& last,
+                      Token& token) {
+
+  std::string::const_iterator curr = it;
+
+  if (!lexNumber(curr, last, token.min))
+
+    return false;
+
+  token.max = token.min;
 
-  auto it = stackTopMatch(tokenStack, args...);
+  if (curr != last && *curr == ',') {
 
-  if (it == std::end(tokenStack))
+    if (!lexNumber(++curr, last, token.max))
 
-    return it;
+      token.max = UNBOUNDED;
+  }
+
+  if (curr == last || *curr != '}')
+
+    return false;
 
-  if ((--it)->type == type)
+  if (token.min > token.max)
 
-    return it;
-  else
+    throw BadParse();
+
+  it = curr;
 
-    return std::end(tokenStack);
+  return true;
 }
 
-template <typename... Args>
-std::vector<Token> popIfMatch(std::vector<Token>& tokenStack,
-                              Args... args) {
+/**
+ * Reads a bracket expression such as [a-z_] or [^"], with it just past the
+ * '['. A ']' right after the '[' or '^' is an ordinary symbol, as is a '-'
+ * which cannot be part of a range, and a backslash escapes the symbol after
+ * it.
+ *
+ * @return The symbols it matches. EPSILON is never among them.
+ */
+static FA::symbol_set_type lexClass(std::string::const_iterator& it,
+                                    const std::string::const_iterator& last) {
+
+  FA::symbol_set_type symbols;
 
-  auto it = stackTopMatch(tokenStack, args...);
+  const bool negated = it != last && *it == '^';
+
+  if (negated) ++it;
+
+  auto next = [&] () -> unsigned char {
+
+    if (it == last || (*it == '\\' && ++it == last))
+
+      throw BadParse();
+
+    return static_cast<unsigned char>(*it++);
+  };
 
-  std::vector<Token> stackTop;
+  for (bool first = true; it == last || *it != ']' || first; first = false) {
 
-  std::copy(it, std::end(tokenStack), std::back_inserter(stackTop));
-  tokenStack.erase(it, std::end(tokenStack));
+    const unsigned char lo = next();
+    unsigned char hi = lo;
 
-  return stackTop;
+    if (it != last && *it == '-' && it + 1 != last && *(it + 1) != ']') {
+
+      ++it;
+      hi = next();
+
+      if (hi < lo)
+
+        throw BadParse();
+    }
+
+    for (unsigned c = lo; c <= hi; ++c)
+
+      symbols.set(c);
+  }
+
+  if (negated)
+
+    symbols.flip();
+
+  symbols.reset(static_cast<unsigned char>(EPSILON));
+
+  return symbols;
 }
 
-std::vector<Token> lex(const std::string& regex) {
+/**
+ * Splits a regex into tokens.
+ *
+ * @param  regex   The regex.
+ * @param  symbols Receives the set of symbols for each SYMBOLS token.
+ * @return         The tokens.
+ */
+static std::vector<Token> lex( const std::string& regex,
+                               std::vector<FA::symbol_set_type>& symbols) {
 
   std::vector<Token> tokens;
 
+  tokens.reserve(regex.length());
+
+  auto addSymbols = [&] (const FA::symbol_set_type& set) {
+
+    tokens.push_back({TokenType::SYMBOLS, symbols.size(), 0, 0});
+    symbols.push_back(set);
+  };
+
+  auto addSymbol = [&] (const char& c) {
+
+    FA::symbol_set_type set;
+
+    set.set(static_cast<unsigned char>(c));
+
+    addSymbols(set);
+  };
+
   /* Can't use std::transform because I have to deal with backslashes... */
-  for (auto it = std::begin(regex); it != std::end(regex); ++it)
+  for (auto it = std::begin(regex); it != std::end(regex); ++it) {
+
+    Token bounds = {TokenType::BOUNDS, 0, 0, 0};
 
     switch (*it) {
 
     default :
-      tokens.emplace_back(TokenType::CHAR, std::string {*it});
+      addSymbol(*it);
       break;
 
     case '\\' :
-      tokens.emplace_back(TokenType::CHAR, std::string {*++it});
+      if (++it == std::end(regex))
+
+        throw BadParse();
+
+      addSymbol(*it);
+      break;
+
+    case '.' : {
+
+      FA::symbol_set_type set;
+
+      set.set();
+      set.reset(static_cast<unsigned char>('\n'));
+      set.reset(static_cast<unsigned char>(EPSILON));
+
+      addSymbols(set);
+      break;
+    }
+
+    case '[' :
+      addSymbols(lexClass(++it, std::end(regex)));
+      break;
+
+    case '{' :
+      if (lexBounds(++it, std::end(regex), bounds))
+
+        tokens.push_back(bounds);
+      else
+
+        addSymbol(*--it);
+
       break;
 
     case '*' :
-      tokens.emplace_back(TokenType::STAR, "*");
+      tokens.push_back({TokenType::STAR, 0, 0, 0});
+      break;
+
+    case '+' :
+      tokens.push_back({TokenType::PLUS, 0, 0, 0});
+      break;
+
+    case '?' :
+      tokens.push_back({TokenType::QUESTION, 0, 0, 0});
       break;
 
     case '|' :
-      tokens.emplace_back(TokenType::V_BAR, "|");
+      tokens.push_back({TokenType::V_BAR, 0, 0, 0});
       break;
 
     case '(' :
-      tokens.emplace_back(TokenType::L_PAREN, "(");
+      tokens.push_back({TokenType::L_PAREN, 0, 0, 0});
       break;
 
     case ')' :
-      tokens.emplace_back(TokenType::R_PAREN, ")");
+      tokens.push_back({TokenType::R_PAREN, 0, 0, 0});
       break;
     }
+  }
 
   return tokens;
 }
 
-std::unique_ptr<FA> parse(const std::vector<Token> tokens) {
+/**
+ * Parses a regex into a syntax tree, in one pass and without recursion.
+ *
+ * This is operator precedence parsing with an explicit stack of pending
+ * operators: the postfix operators ('*', '+', '?' and bounds) bind tightest,
+ * then concatenation (which has no token of its own), then '|'. Both binary
+ * operators are left associative. An operand which is missing, as in "a|",
+ * "(|b)" or "()", is the empty string.
+ *
+ * @param  tokens The tokens of the regex.
+ * @return        The syntax tree, in postfix order.
+ */
+static std::vector<Node> parse(const std::vector<Token>& tokens) {
 
-  std::vector<Token> tokenStack;
-  std::vector<Token> tokenSlice;
-  std::vector<std::unique_ptr<FA>> faStack;
+  std::vector<Node> nodes;
 
-  auto fromChar = [] (const char& c) -> std::unique_ptr<FA> {
+  std::vector<Operator> operators;
+
+  /* Where the nodes of each complete operand begin, innermost last. */
+  std::vector<size_t> operands;
+
+  bool expectOperand = true;
+
+  auto addNode = [&] (const NodeType& type, const size_t& arg,
+                      const unsigned& min, const unsigned& max) {
+
+    switch (type) {
+
+    case NodeType::EMPTY :
+    case NodeType::SYMBOLS :
+      operands.push_back(nodes.size());
+      break;
 
-    return FABuilder()
-      .initial_state("0")
-      .transition("0", c, "1")
-      .final_state("1")
-      .build();
+    case NodeType::CONCATENATE :
+    case NodeType::ALTERNATE :
+      operands.pop_back();
+      break;
+
+    default :
+      break;
+    }
+
+    nodes.push_back({type, arg, min, max});
   };
 
-  auto it = std::begin(tokens);
- 
-  const std::function<void (void)> expr = [&] () {
-
-    if (!(tokenSlice = popIfMatch(tokenStack, TokenType::CHAR)).empty()) {
-
-      tokenStack.emplace_back(TokenType::EXPR, tokenSlice[0].value);
-      faStack.push_back(std::move(fromChar(tokenSlice[0].value.front())));
-
-#ifdef DEBUG
-      fprintf(stderr, "Reduce '%s'\n", tokenSlice[0].value.c_str());
-#endif  // DEBUG
-
-      expr();
-    } else if (!(tokenSlice = popIfMatch(tokenStack,  TokenType::EXPR, 
-                                                      TokenType::EXPR)).empty() 
-                and it->type != TokenType::STAR) {
-
-      tokenStack.emplace_back(TokenType::EXPR,  tokenSlice[0].value + 
-                                                tokenSlice[1].value);
-
-#ifdef DEBUG
-      fprintf(stderr, "Reduce '%s' + '%s'\n", tokenSlice[0].value.c_str(), 
-                                              tokenSlice[1].value.c_str());
-#endif  // DEBUG
-
-      std::unique_ptr<FA> fa1 = std::move(faStack.back()); faStack.pop_back();
-      std::unique_ptr<FA> fa0 = std::move(faStack.back()); faStack.pop_back();
-      faStack.push_back(std::move(FA::concatenate(std::move(fa0), std::move(fa1))));
-    } else if (!(tokenSlice = popIfMatch(tokenStack,  TokenType::EXPR, 
-                                                      TokenType::STAR)).empty()) {
-
-      tokenStack.emplace_back(TokenType::EXPR,  tokenSlice[0].value + 
-                                                tokenSlice[1].value);
-
-#ifdef DEBUG
-      fprintf(stderr, "Reduce '%s' + '%s'\n", tokenSlice[0].value.c_str(), 
-                                              tokenSlice[1].value.c_str());
-#endif  // DEBUG
-
-      std::unique_ptr<FA> fa = std::move(faStack.back()); faStack.pop_back();
-      faStack.push_back(std::move(FA::repeat(std::move(fa))));
-    } else if (!(tokenSlice = popIfMatch(tokenStack,  TokenType::EXPR, 
-                                                      TokenType::V_BAR,
-                                                      TokenType::EXPR)).empty()) {
-
-      tokenStack.emplace_back(TokenType::EXPR,  tokenSlice[0].value + 
-                                                tokenSlice[1].value + 
-                                                tokenSlice[2].value);
-
-#ifdef DEBUG
-      fprintf(stderr, "Reduce '%s' + '%s' + '%s'\n",  tokenSlice[0].value.c_str(),
-                                                      tokenSlice[1].value.c_str(),
-                                                      tokenslice[2].value.c_str());
-#endif  // DEBUG
-
-      std::unique_ptr<FA> fa1 = std::move(faStack.back()); faStack.pop_back();
-      std::unique_ptr<FA> fa0 = std::move(faStack.back()); faStack.pop_back();
-      faStack.push_back(std::move(FA::alternate(std::move(fa0), std::move(fa1))));
-    } else if (!(tokenSlice = popIfMatch(tokenStack,  TokenType::L_PAREN, 
-                                                      TokenType::EXPR,
-                                                      TokenType::R_PAREN)).empty()) {
-
-      tokenStack.emplace_back(TokenType::EXPR,  tokenSlice[0].value + 
-                                                tokenSlice[1].value + 
-                                                tokenSlice[2].value);
-
-#ifdef DEBUG
-      fprintf(stderr, "Reduce '%s' + '%s' + '%s'\n",  tokenSlice[0].value.c_str(), 
-                                                      tokenSlice[1].value.c_str(), 
-                                                      tokenSlice[2].value.c_str());
-#endif  // DEBUG
-    } else {
-
-      if (it == std::end(tokens))
-
-        return;
-
-      tokenStack.push_back(*it++);
-
-#ifdef DEBUG
-      fprintf(stderr, "Shift '%s'\n", tokenStack.back().value.c_str());
-#endif  // DEBUG
+  /* Emits the pending operators, back to the innermost open parenthesis,
+   * which bind at least as tightly as op.
+   */
+  auto reduce = [&] (const Operator& op) {
+
+    while (!operators.empty() && operators.back() != Operator::GROUP &&
+           (operators.back() == Operator::CONCATENATE ||
+            op == Operator::ALTERNATE)) {
+
+      addNode(operators.back() == Operator::CONCATENATE ?
+                NodeType::CONCATENATE : NodeType::ALTERNATE,
+              0, 0, 0);
+      operators.pop_back();
     }
+  };
+
+  /* Starting an operand right after another one concatenates them. */
+  auto beginOperand = [&] () {
+
+    if (!expectOperand) {
+
+      reduce(Operator::CONCATENATE);
+      operators.push_back(Operator::CONCATENATE);
+    }
+
+    expectOperand = false;
+  };
+
+  auto endAlternative = [&] () {
+
+    if (expectOperand)
+
+      addNode(NodeType::EMPTY, 0, 0, 0);
+
+    reduce(Operator::ALTERNATE);
+  };
+
+  auto postfix = [&] (const NodeType& type, const unsigned& min,
+                      const unsigned& max) {
+
+    if (expectOperand)
+
+      throw BadParse();
 
-    expr();
+    addNode(type, operands.back(), min, max);
   };
 
-  expr();
+  nodes.reserve(2 * tokens.size() + 1);
 
-  if (faStack.size() != 1)
+  for (const Token& token : tokens) {
+
+    switch (token.type) {
+
+    case TokenType::SYMBOLS :
+      beginOperand();
+      addNode(NodeType::SYMBOLS, token.symbols, 0, 0);
+      break;
+
+    case TokenType::STAR :
+      postfix(NodeType::REPEAT, 0, 0);
+      break;
+
+    case TokenType::PLUS :
+      postfix(NodeType::PLUS, 0, 0);
+      break;
+
+    case TokenType::QUESTION :
+      postfix(NodeType::OPTIONAL, 0, 0);
+      break;
+
+    case TokenType::BOUNDS :
+      postfix(NodeType::BOUNDED, token.min, token.max);
+      break;
+
+    case TokenType::V_BAR :
+      endAlternative();
+      operators.push_back(Operator::ALTERNATE);
+      expectOperand = true;
+      break;
+
+    case TokenType::L_PAREN :
+      beginOperand();
+      operators.push_back(Operator::GROUP);
+      expectOperand = true;
+      break;
+
+    case TokenType::R_PAREN :
+      endAlternative();
+
+      if (operators.empty())
+
+        throw BadParse();
+
+      operators.pop_back();
+      expectOperand = false;
+      break;
+    }
+  }
+
+  endAlternative();
+
+  if (!operators.empty())
 
     throw BadParse();
 
-  return std::move(faStack.front());
+  return nodes;
+}
+
+/**
+ * Checks that building a syntax tree would not copy more than MAX_POSITIONS
+ * symbols, counting every copy that evaluate makes for bounds.
+ *
+ * @param nodes The syntax tree, in postfix order.
+ */
+static void checkSize(const std::vector<Node>& nodes) {
+
+  /* The number of symbols in each operand, innermost last. A count never
+   * goes past MAX_POSITIONS + 1, so it cannot overflow.
+   */
+  std::vector<size_t> sizes;
+
+  for (const Node& node : nodes) {
+
+    switch (node.type) {
+
+    case NodeType::EMPTY :
+      sizes.push_back(0);
+      break;
+
+    case NodeType::SYMBOLS :
+      sizes.push_back(1);
+      break;
+
+    case NodeType::BOUNDED : {
+
+      const size_t copies = std::max<size_t>(
+        node.max == UNBOUNDED ? node.min : node.max, 1);
+
+      /* An empty operand is counted as a symbol, since its copies still
+       * take time to make.
+       */
+      const size_t size = std::max<size_t>(sizes.back(), 1);
+
+      if (copies > MAX_POSITIONS / size)
+
+        throw BadParse();
+
+      sizes.back() = size * copies;
+      break;
+    }
+
+    case NodeType::CONCATENATE :
+    case NodeType::ALTERNATE :
+      sizes[sizes.size() - 2] += sizes.back();
+      sizes.pop_back();
+      break;
+
+    default :
+      break;
+    }
+
+    if (sizes.back() > MAX_POSITIONS)
+
+      throw BadParse();
+  }
 }
 
-std::unique_ptr<FA> FA::fromRegex(const std::string& regex) {
+/**
+ * Evaluates the nodes in [first, last), which must form one whole operand,
+ * with a builder.
+ *
+ * A bounded repetition needs a separate copy of its operand for each
+ * repetition, so its operand's nodes are evaluated again for each copy after
+ * the first. x{m,n} becomes m copies followed by n - m nested optional ones,
+ * as in xx(x(x)?)?, and x{m,} ends in x+ (or x* if m is 0), so no more than
+ * max(m, n, 1) copies are made.
+ *
+ * @param  builder The builder.
+ * @param  nodes   The syntax tree, in postfix order.
+ * @param  symbols The symbol sets of the SYMBOLS nodes.
+ * @param  first   The first node of the operand.
+ * @param  last    One past its last node.
+ * @return         The operand's fragment.
+ */
+template <typename Builder>
+static typename Builder::Fragment evaluate(
+  Builder& builder,
+  const std::vector<Node>& nodes,
+  const std::vector<FA::symbol_set_type>& symbols,
+  const size_t& first,
+  const size_t& last) {
+
+  typedef typename Builder::Fragment Fragment;
+
+  std::vector<Fragment> fragments;
+
+  for (size_t i = first; i < last; ++i) {
+
+    const Node& node = nodes[i];
+
+    switch (node.type) {
+
+    case NodeType::EMPTY :
+      fragments.push_back(builder.empty());
+      break;
+
+    case NodeType::SYMBOLS :
+      fragments.push_back(builder.symbols(symbols[node.arg]));
+      break;
+
+    case NodeType::REPEAT :
+      fragments.back() = builder.repeat(fragments.back());
+      break;
+
+    case NodeType::PLUS :
+      fragments.back() = builder.plus(fragments.back());
+      break;
+
+    case NodeType::OPTIONAL :
+      fragments.back() = builder.optional(fragments.back());
+      break;
+
+    case NodeType::BOUNDED : {
+
+      auto copy = [&] () -> Fragment {
+
+        return evaluate(builder, nodes, symbols, node.arg, i);
+      };
+
+      Fragment frag = std::move(fragments.back());
+
+      if (node.max == UNBOUNDED) {
+
+        frag = node.min == 0 ? builder.repeat(frag) : builder.plus(frag);
+
+        for (unsigned n = 1; n < node.min; ++n)
+
+          frag = builder.concatenate(copy(), frag);
+      } else if (node.max == 0) {
+
+        frag = builder.empty();
+      } else if (node.min == node.max) {
+
+        for (unsigned n = 1; n < node.min; ++n)
+
+          frag = builder.concatenate(copy(), frag);
+      } else {
+
+        frag = builder.optional(frag);
 
-  if (regex.length() == 0)
+        for (unsigned n = node.min + 1; n < node.max; ++n)
 
-    return FABuilder()
-      .initial_state("0")
-      .final_state("0")
-      .build();
+          frag = builder.optional(builder.concatenate(copy(), frag));
 
-  std::vector<Token> tokens = lex(regex);
+        for (unsigned n = 0; n < node.min; ++n)
+
+          frag = builder.concatenate(copy(), frag);
+      }
+
+      fragments.back() = std::move(frag);
+      break;
+    }
+
+    case NodeType::CONCATENATE :
+    case NodeType::ALTERNATE : {
+
+      const Fragment frag1 = std::move(fragments.back()); fragments.pop_back();
+      const Fragment frag0 = std::move(fragments.back()); fragments.pop_back();
+
+      fragments.push_back(node.type == NodeType::CONCATENATE ?
+                            builder.concatenate(frag0, frag1) :
+                            builder.alternate(frag0, frag1));
+      break;
+    }
+    }
+  }
+
+  return fragments.back();
+}
+
+/**
+ * Builds an FA from a syntax tree.
+ *
+ * @param  nodes   The syntax tree, in postfix order.
+ * @param  symbols The symbol sets of the SYMBOLS nodes.
+ * @return         The FA.
+ */
+template <typename Builder>
+static std::unique_ptr<FA> build(const std::vector<Node>& nodes,
+                                 const std::vector<FA::symbol_set_type>& symbols) {
+
+  Builder builder;
+
+  return builder.build(evaluate(builder, nodes, symbols, 0, nodes.size()));
+}
+
+std::unique_ptr<FA> FA::fromRegex(const std::string& regex,
+                                  const Construction& construction) {
 
   try {
 
-    return parse(tokens);
+    std::vector<symbol_set_type> symbols;
+
+    const std::vector<Node> nodes = parse(lex(regex, symbols));
+
+    checkSize(nodes);
+
+    if (construction == Construction::GLUSHKOV)
+
+      return build<GlushkovBuilder>(nodes, symbols);
+
+    return build<ThompsonBuilder>(nodes, symbols);
   } catch (const BadParse& e) {
 
     throw BadRegex(regex);